@@ -0,0 +1,132 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "cartesian_kernel.hpp"
+#include "light_ray.hpp"
+#include "parallel.hpp"
+#include "physics.hpp"
+#include "ray_store.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Batch size, kernel width and thread count for RayStore.
+struct TuneConfig
+{
+    size_t batchSize = 4096;
+    int simdWidth = 0;
+    unsigned threads = 1;
+
+    void ApplyTo(RayStore &store) const
+    {
+        store.batchSize = batchSize;
+        store.simdWidth = simdWidth;
+        store.threads = threads;
+    }
+};
+
+// Picks the fastest RayStore configuration for this machine by timing every
+// combination of the candidates on a synthetic fan of rays, and keeps the
+// result in a small text file so later runs skip the measurement. The file
+// records the hardware thread count, Schwarzschild radius and frame length it
+// was tuned for and is ignored when any of them differs.
+struct Autotuner
+{
+    std::string cachePath = "autotune.cache";
+    size_t rays = 16384; // Rays in the benchmark store
+    int repeats = 5;     // Timed frames per configuration; the fastest counts
+
+    std::vector<size_t> batchSizes = {256, 1024, 4096, 16384};
+
+    // Loads the configuration cached for this black hole (r_s in meters) and
+    // frame length (dt in simulated seconds), tuning and saving one if there
+    // is none.
+    TuneConfig LoadOrTune(double r_s, double dt)
+    {
+        TuneConfig config;
+        if (Load(config, r_s, dt))
+            return config;
+        config = Tune(r_s, dt);
+        Save(config, r_s, dt);
+        return config;
+    }
+
+    bool Load(TuneConfig &config, double r_s, double dt) const
+    {
+        std::ifstream in(cachePath);
+        unsigned hardware = 0;
+        double tunedRs = 0, tunedDt = 0;
+        TuneConfig loaded;
+        if (!(in >> hardware >> tunedRs >> tunedDt >> loaded.batchSize >> loaded.simdWidth >> loaded.threads))
+            return false;
+        if (hardware != DefaultThreadCount() || tunedRs != r_s || tunedDt != dt)
+            return false;
+        config = loaded;
+        return true;
+    }
+
+    void Save(const TuneConfig &config, double r_s, double dt) const
+    {
+        std::ofstream out(cachePath);
+        out.precision(std::numeric_limits<double>::max_digits10); // Reads back exactly
+        out << DefaultThreadCount() << ' ' << r_s << ' ' << dt << ' ' << config.batchSize << ' ' << config.simdWidth
+            << ' ' << config.threads << '\n';
+    }
+
+    TuneConfig Tune(double r_s, double dt) const
+    {
+        // Rays from the left edge over a range of impact parameters, all on
+        // the finest level so every configuration runs the same work
+        std::vector<LightRay> fan;
+        RayStore base;
+        base.sortEvery = 0;
+        for (size_t i = 0; i < rays; ++i)
+        {
+            float offset = static_cast<float>(-450.0 + 900.0 * (i + 0.5) / rays);
+            fan.emplace_back(Vector2{-800.0f, offset}, Vector2{1, 0});
+            base.Add(fan.back(), static_cast<int>(i), r_s);
+        }
+
+        std::vector<unsigned> threadCounts;
+        for (unsigned t = 1; t < DefaultThreadCount(); t *= 2)
+            threadCounts.push_back(t);
+        threadCounts.push_back(DefaultThreadCount());
+
+        TuneConfig best;
+        double bestTime = std::numeric_limits<double>::infinity();
+        for (size_t batch : batchSizes)
+            for (int width : CARTESIAN_WIDTHS)
+                for (unsigned threads : threadCounts)
+                {
+                    TuneConfig config{batch, width, threads};
+                    double seconds = Measure(base, config, dt, r_s);
+                    if (seconds < bestTime)
+                    {
+                        bestTime = seconds;
+                        best = config;
+                    }
+                }
+        return best;
+    }
+
+    // Fastest time over `repeats` frames of stepping, from the same state.
+    double Measure(const RayStore &base, const TuneConfig &config, double dt, double r_s) const
+    {
+        double fastest = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < repeats; ++i)
+        {
+            RayStore store = base;
+            config.ApplyTo(store);
+            auto start = std::chrono::steady_clock::now();
+            store.StepRuns(store.single, dt, r_s);
+            store.StepRuns(store.precise, dt, r_s);
+            fastest = std::min(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return fastest;
+    }
+};
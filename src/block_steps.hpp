@@ -0,0 +1,120 @@
+#pragma once
+
+#include "effective_potential.hpp"
+#include "light_ray.hpp"
+#include "ray_profile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Hierarchical (power-of-two) block time steps for a population of rays.
+//
+// A frame of length dt is split into 2^maxLevel ticks. Each ray sits on a
+// level k and steps with dt / 2^k, so rays far from the hole take one step per
+// frame while rays skimming the photon sphere take up to 2^maxLevel. The level
+// comes from the ray's local length scale: the smaller of its distance to the
+// horizon and its radius of curvature, of which a step may cover at most
+// `accuracy`. Compared to stepping every ray at the finest level this saves
+// most of the work, and unlike per-ray adaptive steps there is no
+// error estimation or step rejection.
+//
+// Rays may move to a finer level after any step, but only to a coarser level
+// when their time lines up with that level's ticks, so every ray lands exactly
+// on the frame boundary.
+struct BlockScheduler
+{
+    int maxLevel = 0;       // Finest step is dt / 2^maxLevel; 0 steps once per frame
+    double accuracy = 0.01; // Largest step as a fraction of the local length scale
+    bool classify = true;   // Finalize rays whose fate the effective potential already decides
+    double coastRadius = 8; // Escaped rays move analytically beyond this many r_s, if the far field is on
+
+    std::vector<int> levels; // Current level of each ray
+    long steps = 0;          // Steps taken during the last frame
+
+    RayProfile *profile = nullptr; // Per-ray cost attribution, if set
+
+    // Level a ray needs for a frame of length dt.
+    int Level(const LightRay &ray, double dt, double r_s) const
+    {
+        if (ray.farField.active || ray.atlasTrack.active || ray.winding.active)
+            return 0; // Analytic legs and atlas curves take any step size
+
+        double x = ray.pos.x / VIS_SCALE, y = ray.pos.y / VIS_SCALE;
+        double r = std::sqrt(x * x + y * y);
+
+        // Curvature of the path from the polar kernel's acceleration:
+        // a_perp / c² with sin(psi) the angle between direction and radius
+        double sinPsi = std::abs(x * ray.dir.y - y * ray.dir.x) / r;
+        double curvature = r_s * sinPsi / (2.0 * r * r) * (1.0 + 3.0 * sinPsi * sinPsi);
+
+        double scale = r - r_s;
+        if (curvature > 0.0)
+            scale = std::min(scale, 1.0 / curvature);
+        if (scale <= 0.0)
+            return maxLevel;
+
+        double substeps = c * dt / (accuracy * scale);
+        int level = substeps > 1.0 ? static_cast<int>(std::ceil(std::log2(substeps))) : 0;
+        return std::clamp(level, 0, maxLevel);
+    }
+
+    // Advances all rays by one frame of length dt. Trail points come from each
+    // ray's dense output, so they do not depend on the level a ray ran at.
+    void Update(std::vector<LightRay> &rays, double dt, double r_s, double farFieldRadius)
+    {
+        const int ticks = 1 << maxLevel;
+        levels.resize(rays.size(), 0);
+        std::vector<int> nextTick(rays.size(), 0);
+        EffectivePotential potential(r_s);
+        steps = 0;
+
+        for (size_t i = 0; i < rays.size(); ++i)
+            levels[i] = Level(rays[i], dt, r_s);
+        if (profile)
+            profile->Track(rays);
+
+        for (int tick = 0; tick < ticks; ++tick)
+        {
+            for (size_t i = 0; i < rays.size(); ++i)
+            {
+                LightRay &ray = rays[i];
+                if (nextTick[i] != tick || ray.outcome == RayOutcome::Captured)
+                    continue;
+
+                int level = levels[i];
+                bool timed = profile && profile->Sample();
+                auto start = timed ? RayProfile::Clock::now() : RayProfile::Clock::time_point{};
+
+                if (ray.Advance(dt / (1 << level), r_s, farFieldRadius))
+                    ray.RecordStep();
+                ++steps;
+
+                if (classify && ray.outcome == RayOutcome::Active && ray.kernel == RayKernel::Polar)
+                {
+                    RayOutcome fate = potential.Classify(ray);
+                    if (fate != RayOutcome::Active)
+                        ray.Finalize(fate, coastRadius * r_s);
+                }
+
+                int stride = ticks >> level;
+                nextTick[i] = tick + stride;
+
+                // Refine immediately; coarsen only onto an aligned tick
+                int wanted = Level(ray, dt, r_s);
+                while (wanted < level && nextTick[i] % (ticks >> (level - 1)) == 0)
+                    --level;
+                levels[i] = std::max(wanted, level);
+
+                if (profile)
+                {
+                    profile->Step(static_cast<int>(i));
+                    if (wanted > level)
+                        profile->Reject(static_cast<int>(i)); // The step it just took was too coarse
+                    if (timed)
+                        profile->Charge(static_cast<int>(i), start);
+                }
+            }
+        }
+    }
+};
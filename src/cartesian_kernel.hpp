@@ -0,0 +1,316 @@
+#pragma once
+
+#include "metric.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Trig-free photon kernel.
+//
+// In Schwarzschild the orbit equation u'' + u = (3/2) r_s u² (u = 1/r) is
+// exactly the orbit of a particle under the central acceleration
+//
+//   a = -(3/2) r_s h² x / |x|^5,
+//
+// where h = x × v is the conserved specific angular momentum. Integrated in
+// Cartesian coordinates this needs one inverse square root per step and no
+// sin, cos, atan2 or polar conversion, and the same straight-line code runs
+// for one ray or a whole batch.
+//
+// Unlike the polar formulation in LightRay this is the exact null geodesic:
+// its photon sphere is at 1.5 r_s and b_crit = 3*sqrt(3)/2 r_s. The speed is
+// not pinned to c -- the parameter is not coordinate time -- but the shape of
+// the path is exact.
+//
+// Everything here works in units of r_s for lengths and r_s/c for time, which
+// keeps the numbers small enough for single precision.
+
+// k = (3/2) h², the per-ray constant of the acceleration. Other spacetimes
+// scale it by their Metric::Factor (metric.hpp).
+template <typename Real, typename Metric = Schwarzschild>
+inline void CartesianAcceleration(Real x, Real y, Real k, Real &ax, Real &ay)
+{
+    Real r2 = x * x + y * y;
+    Real invR = Real(1) / std::sqrt(r2);
+    Real invR2 = invR * invR;
+    Real s = -k * invR2 * invR2 * invR * Metric::template Factor<Real>(invR); // -k / r^5 in Schwarzschild
+    ax = s * x;
+    ay = s * y;
+}
+
+// Advances n rays stored as separate arrays by one kick-drift-kick (velocity
+// Verlet) step. The accelerations are carried between steps, so each step
+// costs one force evaluation. The loop body has no branches and the arrays do
+// not alias, so compilers vectorize it.
+template <typename Real, typename Metric = Schwarzschild>
+void StepCartesian(size_t n, Real *__restrict x, Real *__restrict y, Real *__restrict vx, Real *__restrict vy,
+                   Real *__restrict ax, Real *__restrict ay, const Real *__restrict k, Real dt)
+{
+    const Real half = Real(0.5) * dt;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Real vxi = vx[i] + half * ax[i];
+        Real vyi = vy[i] + half * ay[i];
+        Real xi = x[i] + dt * vxi;
+        Real yi = y[i] + dt * vyi;
+
+        Real axi, ayi;
+        CartesianAcceleration<Real, Metric>(xi, yi, k[i], axi, ayi);
+
+        x[i] = xi;
+        y[i] = yi;
+        vx[i] = vxi + half * axi;
+        vy[i] = vyi + half * ayi;
+        ax[i] = axi;
+        ay[i] = ayi;
+    }
+}
+
+// StepCartesian with each lane picking its own step from its distance to the
+// horizon: accuracy * (r - horizon), clamped to [minStep, maxStep]. The
+// carried acceleration does not depend on the step, so lanes may change step
+// freely.
+template <typename Real, typename Metric = Schwarzschild>
+void StepCartesianAdaptive(size_t n, Real *__restrict x, Real *__restrict y, Real *__restrict vx,
+                           Real *__restrict vy, Real *__restrict ax, Real *__restrict ay, const Real *__restrict k,
+                           Real accuracy, Real minStep, Real maxStep)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        Real r = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        Real dt = std::min(std::max(accuracy * (r - Real(Metric::HORIZON)), minStep), maxStep);
+        Real half = Real(0.5) * dt;
+
+        Real vxi = vx[i] + half * ax[i];
+        Real vyi = vy[i] + half * ay[i];
+        Real xi = x[i] + dt * vxi;
+        Real yi = y[i] + dt * vyi;
+
+        Real axi, ayi;
+        CartesianAcceleration<Real, Metric>(xi, yi, k[i], axi, ayi);
+
+        x[i] = xi;
+        y[i] = yi;
+        vx[i] = vxi + half * axi;
+        vy[i] = vyi + half * ayi;
+        ax[i] = axi;
+        ay[i] = ayi;
+    }
+}
+
+// The same step with the loop cut into blocks of Width lanes. Each block has
+// a constant trip count, so the compiler emits straight vector code of that
+// width; the remainder runs through the plain loop.
+template <typename Real, int Width, typename Metric = Schwarzschild>
+void StepCartesianBlocked(size_t n, Real *x, Real *y, Real *vx, Real *vy, Real *ax, Real *ay, const Real *k, Real dt)
+{
+    size_t blocked = n - n % Width;
+    for (size_t i = 0; i < blocked; i += Width)
+        StepCartesian<Real, Metric>(Width, x + i, y + i, vx + i, vy + i, ax + i, ay + i, k + i, dt);
+    StepCartesian<Real, Metric>(n - blocked, x + blocked, y + blocked, vx + blocked, vy + blocked, ax + blocked,
+                                ay + blocked, k + blocked, dt);
+}
+
+// Widths StepCartesianWidth accepts; 0 leaves the plain loop to the compiler.
+constexpr int CARTESIAN_WIDTHS[] = {0, 4, 8, 16};
+
+template <typename Real, typename Metric = Schwarzschild>
+void StepCartesianWidth(int width, size_t n, Real *x, Real *y, Real *vx, Real *vy, Real *ax, Real *ay,
+                        const Real *k, Real dt)
+{
+    switch (width)
+    {
+    case 4:
+        StepCartesianBlocked<Real, 4, Metric>(n, x, y, vx, vy, ax, ay, k, dt);
+        break;
+    case 8:
+        StepCartesianBlocked<Real, 8, Metric>(n, x, y, vx, vy, ax, ay, k, dt);
+        break;
+    case 16:
+        StepCartesianBlocked<Real, 16, Metric>(n, x, y, vx, vy, ax, ay, k, dt);
+        break;
+    default:
+        StepCartesian<Real, Metric>(n, x, y, vx, vy, ax, ay, k, dt);
+        break;
+    }
+}
+
+// Ray differentials. A tangent (jx, jy, jvx, jvy) is the derivative of a
+// ray's position and velocity with respect to one launch parameter, and dk
+// that of k. It obeys the linearised equation of motion, with u = 1/r and
+// F, F' the metric's Factor and FactorSlope at u,
+//
+//   j'' = -F (dk x + k j) u^5 + k (5 F + u F') (x.j) u^7 x,
+//
+// which the same kick-drift-kick step integrates alongside the ray, so the
+// pair stays consistent to round-off and the Jacobian of the discrete map is
+// exact. In Schwarzschild (F = 1) this is -(dk x + k (j - 5 x (x.j) / r²)) / r^5.
+template <typename Real, typename Metric = Schwarzschild>
+inline void CartesianTangentAcceleration(Real x, Real y, Real k, Real jx, Real jy, Real dk, Real &jax, Real &jay)
+{
+    Real r2 = x * x + y * y;
+    Real invR = Real(1) / std::sqrt(r2);
+    Real invR2 = invR * invR;
+    Real invR5 = invR2 * invR2 * invR;
+    Real f = Metric::template Factor<Real>(invR);
+    Real radial = (Real(5) * f + invR * Metric::template FactorSlope<Real>(invR)) * (x * jx + y * jy) * invR2;
+    jax = -invR5 * (f * dk * x + k * (f * jx - radial * x));
+    jay = -invR5 * (f * dk * y + k * (f * jy - radial * y));
+}
+
+// StepCartesian carrying one tangent per ray. Still branch-free.
+template <typename Real, typename Metric = Schwarzschild>
+void StepCartesianDifferential(size_t n, Real *__restrict x, Real *__restrict y, Real *__restrict vx,
+                               Real *__restrict vy, Real *__restrict ax, Real *__restrict ay,
+                               const Real *__restrict k, Real *__restrict jx, Real *__restrict jy,
+                               Real *__restrict jvx, Real *__restrict jvy, Real *__restrict jax,
+                               Real *__restrict jay, const Real *__restrict dk, Real dt)
+{
+    const Real half = Real(0.5) * dt;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Real vxi = vx[i] + half * ax[i];
+        Real vyi = vy[i] + half * ay[i];
+        Real xi = x[i] + dt * vxi;
+        Real yi = y[i] + dt * vyi;
+        Real jvxi = jvx[i] + half * jax[i];
+        Real jvyi = jvy[i] + half * jay[i];
+        Real jxi = jx[i] + dt * jvxi;
+        Real jyi = jy[i] + dt * jvyi;
+
+        Real axi, ayi, jaxi, jayi;
+        CartesianAcceleration<Real, Metric>(xi, yi, k[i], axi, ayi);
+        CartesianTangentAcceleration<Real, Metric>(xi, yi, k[i], jxi, jyi, dk[i], jaxi, jayi);
+
+        x[i] = xi;
+        y[i] = yi;
+        vx[i] = vxi + half * axi;
+        vy[i] = vyi + half * ayi;
+        ax[i] = axi;
+        ay[i] = ayi;
+        jx[i] = jxi;
+        jy[i] = jyi;
+        jvx[i] = jvxi + half * jaxi;
+        jvy[i] = jvyi + half * jayi;
+        jax[i] = jaxi;
+        jay[i] = jayi;
+    }
+}
+
+// Cartesian state of a single ray, for LightRay's scalar path.
+struct CartesianState
+{
+    bool ready = false;
+    double x = 0.0, y = 0.0;   // Position (r_s)
+    double vx = 0.0, vy = 0.0; // Velocity (c)
+    double ax = 0.0, ay = 0.0; // Acceleration at (x, y)
+    double k = 0.0;            // (3/2) h²
+    double e0 = 0.0;           // Energy at launch, to measure drift against
+    Spacetime spacetime = Spacetime::Schwarzschild; // Set before Init
+
+    // Derivative of the state with respect to the launch offset b, measured
+    // to the left of the launch direction (d0x, d0y)
+    bool differentials = false;
+    double jx = 0.0, jy = 0.0, jvx = 0.0, jvy = 0.0, jax = 0.0, jay = 0.0, dk = 0.0;
+    double d0x = 1.0, d0y = 0.0;
+
+    // Starts from a position in r_s and a unit direction, moving at c.
+    void Init(double px, double py, double dx, double dy)
+    {
+        x = px;
+        y = py;
+        vx = dx;
+        vy = dy;
+        double h = x * vy - y * vx;
+        k = 1.5 * h * h;
+
+        // Shifting the launch point sideways moves the position and leaves
+        // the velocity, so dh = j x v
+        d0x = dx;
+        d0y = dy;
+        jx = -dy;
+        jy = dx;
+        jvx = jvy = 0.0;
+        dk = 3.0 * h * (jx * vy - jy * vx);
+
+        WithSpacetime(spacetime,
+                      [&](auto metric)
+                      {
+                          using Metric = decltype(metric);
+                          CartesianAcceleration<double, Metric>(x, y, k, ax, ay);
+                          CartesianTangentAcceleration<double, Metric>(x, y, k, jx, jy, dk, jax, jay);
+                      });
+        e0 = Energy();
+        ready = true;
+    }
+
+    void Step(double dt)
+    {
+        WithSpacetime(spacetime,
+                      [&](auto metric)
+                      {
+                          using Metric = decltype(metric);
+                          if (differentials)
+                              StepCartesianDifferential<double, Metric>(1, &x, &y, &vx, &vy, &ax, &ay, &k, &jx, &jy,
+                                                                        &jvx, &jvy, &jax, &jay, &dk, dt);
+                          else
+                              StepCartesian<double, Metric>(1, &x, &y, &vx, &vy, &ax, &ay, &k, dt);
+                      });
+    }
+
+    double Radius() const { return std::sqrt(x * x + y * y); }
+
+    double Horizon() const
+    {
+        return WithSpacetime(spacetime, [](auto metric) { return decltype(metric)::HORIZON; });
+    }
+
+    // Conserved energy v²/2 + V of the central acceleration, where V(u) =
+    // -(k/3) Bending(u): -k/(3r³) in Schwarzschild.
+    double Energy() const
+    {
+        double u = 1.0 / Radius();
+        double bending = WithSpacetime(spacetime, [&](auto metric) { return decltype(metric)::Bending(u); });
+        return 0.5 * (vx * vx + vy * vy) - k / 3.0 * bending;
+    }
+
+    // (b / b_crit)², with b² = h² / 2E. Photons at the photon sphere u_ps
+    // need 1/b² = u_ps² - Bending(u_ps) to just hover there; in Schwarzschild
+    // that is 4/9 - 8/27, so b_crit² = 27/4.
+    double CriticalRatio() const
+    {
+        double e = Energy();
+        if (e <= 0.0)
+            return 0.0;
+        double critical = WithSpacetime(spacetime,
+                                        [](auto metric)
+                                        {
+                                            using Metric = decltype(metric);
+                                            double u = 1.0 / Metric::PHOTON_SPHERE;
+                                            return 1.0 / (u * u - Metric::Bending(u));
+                                        });
+        return (k / 1.5) / (2.0 * e) / critical;
+    }
+
+    // Sideways spread of the beam per unit launch offset: the part of the
+    // tangent across the current direction. It passes through zero where
+    // neighbouring rays cross (a caustic).
+    double Spread() const
+    {
+        double v = std::sqrt(vx * vx + vy * vy);
+        return std::abs(jx * vy - jy * vx) / v;
+    }
+
+    // Point-lens magnification of the beam at the ray, for a parallel beam
+    // launched along (d0x, d0y) and rotated about the axis through the hole:
+    // in-plane the width changes by Spread(), out of plane by rho / b, with
+    // rho the distance from that axis.
+    double Magnification() const
+    {
+        double b = std::sqrt(k / 1.5);
+        double rho = std::abs(x * d0y - y * d0x);
+        double area = Spread() * rho / b;
+        return area > 0.0 ? 1.0 / area : INFINITY;
+    }
+};
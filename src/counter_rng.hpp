@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011).
+//
+// The generator has no state: each number is a pure function of a key (the
+// seed) and a counter, so any thread can draw the numbers for any ray and
+// step without locking or sharing a stream, and a run gives the same numbers
+// whatever the thread count or the order work is handed out in. Counters are
+// laid out as (draw, step, ray low, ray high); one counter yields four 32-bit
+// words.
+struct CounterRng
+{
+    uint64_t seed = 0;
+
+    using Block = std::array<uint32_t, 4>;
+
+    // Ten Philox rounds on one counter.
+    static Block Philox(Block counter, uint32_t key0, uint32_t key1)
+    {
+        for (int round = 0; round < 10; ++round)
+        {
+            if (round > 0)
+            {
+                key0 += 0x9E3779B9u;
+                key1 += 0xBB67AE85u;
+            }
+            uint64_t p0 = uint64_t(0xD2511F53u) * counter[0];
+            uint64_t p1 = uint64_t(0xCD9E8D57u) * counter[2];
+            counter = {uint32_t(p1 >> 32) ^ counter[1] ^ key0, uint32_t(p1), uint32_t(p0 >> 32) ^ counter[3] ^ key1,
+                       uint32_t(p0)};
+        }
+        return counter;
+    }
+
+    Block Bits(uint64_t ray, uint32_t step, uint32_t draw = 0) const
+    {
+        return Philox({draw, step, uint32_t(ray), uint32_t(ray >> 32)}, uint32_t(seed), uint32_t(seed >> 32));
+    }
+
+    // Uniform in [0, 1) from the top 24 bits, or from 53 bits of two words.
+    static float ToFloat(uint32_t bits) { return (bits >> 8) * (1.0f / 16777216.0f); }
+    static double ToDouble(uint32_t high, uint32_t low)
+    {
+        return ((uint64_t(high) << 21) ^ (low >> 11)) * (1.0 / 9007199254740992.0);
+    }
+
+    // Four uniforms for one ray and step; `draw` numbers further blocks.
+    std::array<float, 4> Uniform(uint64_t ray, uint32_t step, uint32_t draw = 0) const
+    {
+        Block b = Bits(ray, step, draw);
+        return {ToFloat(b[0]), ToFloat(b[1]), ToFloat(b[2]), ToFloat(b[3])};
+    }
+
+    double UniformDouble(uint64_t ray, uint32_t step, uint32_t draw = 0) const
+    {
+        Block b = Bits(ray, step, draw);
+        return ToDouble(b[0], b[1]);
+    }
+
+    // Bulk generation: out[i] = the first uniform of ray firstRay + i at
+    // `step`, for i < count. The rounds run across lanes held as separate
+    // arrays, so compilers vectorize the 32x32->64 multiplies.
+    void Fill(float *out, size_t count, uint64_t firstRay, uint32_t step, uint32_t draw = 0) const
+    {
+        constexpr size_t LANES = 16;
+        for (size_t base = 0; base < count; base += LANES)
+        {
+            uint32_t c0[LANES], c1[LANES], c2[LANES], c3[LANES];
+            for (size_t l = 0; l < LANES; ++l)
+            {
+                uint64_t ray = firstRay + base + l;
+                c0[l] = draw;
+                c1[l] = step;
+                c2[l] = uint32_t(ray);
+                c3[l] = uint32_t(ray >> 32);
+            }
+
+            uint32_t key0 = uint32_t(seed), key1 = uint32_t(seed >> 32);
+            for (int round = 0; round < 10; ++round)
+            {
+                if (round > 0)
+                {
+                    key0 += 0x9E3779B9u;
+                    key1 += 0xBB67AE85u;
+                }
+                for (size_t l = 0; l < LANES; ++l)
+                {
+                    uint64_t p0 = uint64_t(0xD2511F53u) * c0[l];
+                    uint64_t p1 = uint64_t(0xCD9E8D57u) * c2[l];
+                    uint32_t n0 = uint32_t(p1 >> 32) ^ c1[l] ^ key0;
+                    uint32_t n2 = uint32_t(p0 >> 32) ^ c3[l] ^ key1;
+                    c1[l] = uint32_t(p1);
+                    c3[l] = uint32_t(p0);
+                    c0[l] = n0;
+                    c2[l] = n2;
+                }
+            }
+
+            size_t n = count - base < LANES ? count - base : LANES;
+            for (size_t l = 0; l < n; ++l)
+                out[base + l] = ToFloat(c0[l]);
+        }
+    }
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "block_steps.hpp"
+#include "light_ray.hpp"
+#include "metric.hpp"
+#include "parallel.hpp"
+#include "ray_store.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// Capture boundary of a given black hole as seen by LightRay's integrator.
+struct CriticalImpact
+{
+    double b = std::numeric_limits<double>::quiet_NaN(); // Launch offset (pixels) separating capture from escape
+    double bCaptured = 0.0, bEscaped = 0.0;                 // Final bracket: adjacent floats around b
+    double photonSphereRadius = 0.0;                        // Radius (meters) the critical ray winds at
+    int rays = 0;                                           // Number of rays traced to find it
+
+    bool Valid() const { return !std::isnan(b); }
+};
+
+// Locates the critical impact parameter for rays launched like the ones in
+// Simulation: from (-launchDistance, b) in pixels relative to the hole,
+// heading along +x, in the spacetime of Metric (metric.hpp). Rather than
+// trusting the analytic 3*sqrt(3)/2 r_s, it brackets the outcome of the actual
+// integrator (its frame time step, the block scheduler's sub-steps, winding
+// legs and far-field zone, or the RayStore's levels and precision for the
+// Cartesian kernel) so the result is exact for that configuration. The polar
+// kernel is Schwarzschild's, so other metrics always use the Cartesian one.
+//
+// Each round splits the bracket into threads+1 pieces and traces the interior
+// rays in parallel, so with T threads a round gains log2(T+1) bits. It stops
+// once the bracket endpoints are adjacent floats, the resolution LightRay
+// stores positions at. Rays stop as soon as their fate is clear: decided by
+// the effective potential, inside r_s, or moving outwards beyond escapeRadius.
+//
+// Results are cached per metric and every setting they depend on, in a cache
+// all solvers share, so repeated queries (for example each time Simulation
+// launches its rays) are free after the first.
+template <typename Metric = Schwarzschild>
+struct CriticalImpactSolver
+{
+    unsigned threads = 0;       // 0 uses the hardware concurrency
+    double escapeRadius = 3.0;  // In Schwarzschild radii
+    long maxFrames = 2000000;   // Per ray; near-critical rays wind for a long time
+    bool classify = true;       // Stop rays as soon as the effective potential decides them
+    BlockScheduler scheduler;   // Steps each frame the way Simulation's scheduler does
+    bool windingLegs = false;   // As LightRay::windingLegs for the simulation's rays
+
+    RayKernel kernel = RayKernel::Polar;
+    RayStore store; // Settings the Cartesian kernel steps with, as Simulation's store's
+
+    CriticalImpact Find(double r_s, double dt, float launchDistance, double farFieldRadius = 0.0)
+    {
+        std::vector<double> key = Key(r_s, dt, launchDistance, farFieldRadius);
+        Cache &cache = SharedCache();
+        {
+            std::lock_guard<std::mutex> lock(cache.mutex);
+            auto it = cache.results.find(key);
+            if (it != cache.results.end())
+                return it->second;
+        }
+
+        CriticalImpact result = Solve(r_s, dt, launchDistance, farFieldRadius);
+
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.results[key] = result;
+        return result;
+    }
+
+    bool Cartesian() const { return kernel == RayKernel::Cartesian || !std::is_same_v<Metric, Schwarzschild>; }
+
+    // Every setting the result depends on. The thread count sets the probes,
+    // which matters where the outcome is not monotonic in b.
+    std::vector<double> Key(double r_s, double dt, float launchDistance, double farFieldRadius) const
+    {
+        std::vector<double> key = {r_s, dt, launchDistance, escapeRadius, static_cast<double>(maxFrames),
+                                   static_cast<double>(threads), static_cast<double>(Cartesian())};
+        if (Cartesian())
+            key.insert(key.end(), {static_cast<double>(store.maxLevel), store.accuracy,
+                                   static_cast<double>(store.mixedPrecision), store.promoteRadius, store.criticalBand,
+                                   store.driftTolerance, static_cast<double>(store.demote), store.demoteRadius});
+        else
+            key.insert(key.end(), {farFieldRadius, static_cast<double>(classify), static_cast<double>(windingLegs),
+                                   static_cast<double>(scheduler.maxLevel), scheduler.accuracy,
+                                   static_cast<double>(scheduler.classify), scheduler.coastRadius});
+        return key;
+    }
+
+    struct Trace
+    {
+        RayOutcome outcome = RayOutcome::Active;
+        double periapsis = std::numeric_limits<double>::infinity(); // Closest approach (meters)
+    };
+
+    // Integrates a single ray, one frame of length dt at a time, until its
+    // fate is known.
+    Trace Shoot(float b, double r_s, double dt, float launchDistance, double farFieldRadius) const
+    {
+        std::vector<LightRay> rays{LightRay(Vector2{-launchDistance, b}, Vector2{1, 0})};
+        LightRay &ray = rays[0];
+        ray.recordPath = false;
+        ray.windingLegs = windingLegs;
+
+        BlockScheduler stepper = scheduler; // Per-ray levels are this trace's own
+        stepper.classify = classify;
+        stepper.profile = nullptr;
+
+        RayStore batch = store;
+        if (Cartesian())
+        {
+            batch.Clear();
+            batch.spacetime = SpacetimeOf<Metric>();
+            batch.differentials = false;
+            batch.threads = 1;
+            batch.profile = nullptr;
+            batch.Add(ray, 0, r_s);
+        }
+
+        Trace trace;
+        for (long frame = 0; frame < maxFrames; ++frame)
+        {
+            if (Cartesian())
+                batch.Update(rays, dt, r_s);
+            else
+                stepper.Update(rays, dt, r_s, farFieldRadius);
+            if (ray.outcome != RayOutcome::Active)
+            {
+                trace.outcome = ray.outcome;
+                return trace;
+            }
+
+            double r = hypot(ray.pos.x, ray.pos.y) / VIS_SCALE;
+            trace.periapsis = std::min(trace.periapsis, r);
+
+            bool outbound = ray.pos.x * ray.dir.x + ray.pos.y * ray.dir.y > 0.0f;
+            if (outbound && r > escapeRadius * r_s)
+            {
+                trace.outcome = RayOutcome::Escaped;
+                return trace;
+            }
+        }
+        return trace; // Still winding: as close to critical as we can resolve
+    }
+
+private:
+    struct Cache
+    {
+        std::mutex mutex;
+        std::map<std::vector<double>, CriticalImpact> results;
+    };
+
+    // One per metric, shared by every solver
+    static Cache &SharedCache()
+    {
+        static Cache cache;
+        return cache;
+    }
+
+    CriticalImpact Solve(double r_s, double dt, float launchDistance, double farFieldRadius) const
+    {
+        CriticalImpact result;
+
+        // A head-on ray is always captured; a ray launched as far off-axis as
+        // it starts away from the hole should escape.
+        float lo = 0.0f;
+        float hi = launchDistance;
+        Trace hiTrace = Shoot(hi, r_s, dt, launchDistance, farFieldRadius);
+        result.rays = 2;
+        if (Shoot(lo, r_s, dt, launchDistance, farFieldRadius).outcome != RayOutcome::Captured ||
+            hiTrace.outcome != RayOutcome::Escaped)
+            return result;
+
+        unsigned n = threads > 0 ? threads : DefaultThreadCount();
+        std::vector<float> probes;
+        std::vector<Trace> traces;
+
+        while (std::nextafter(lo, hi) != hi)
+        {
+            // Interior probes, kept strictly inside the bracket and distinct
+            probes.clear();
+            for (unsigned i = 1; i <= n; ++i)
+            {
+                float p = static_cast<float>(lo + (static_cast<double>(hi) - lo) * i / (n + 1));
+                p = std::clamp(p, std::nextafter(lo, hi), std::nextafter(hi, lo));
+                if (probes.empty() || p > probes.back())
+                    probes.push_back(p);
+            }
+
+            traces.assign(probes.size(), Trace{});
+            ParallelFor(probes.size(), [&](size_t i)
+                        { traces[i] = Shoot(probes[i], r_s, dt, launchDistance, farFieldRadius); }, n);
+            result.rays += static_cast<int>(probes.size());
+
+            // Outcome is monotonic in b: keep the first captured -> escaped flip
+            size_t i = 0;
+            while (i < probes.size() && traces[i].outcome == RayOutcome::Captured)
+                ++i;
+
+            if (i < probes.size() && traces[i].outcome == RayOutcome::Active)
+            {
+                // Winding longer than maxFrames: this probe is the boundary
+                lo = hi = probes[i];
+                hiTrace = traces[i];
+                break;
+            }
+
+            if (i > 0)
+                lo = probes[i - 1];
+            if (i < probes.size())
+            {
+                hi = probes[i];
+                hiTrace = traces[i];
+            }
+        }
+
+        result.bCaptured = lo;
+        result.bEscaped = hi;
+        result.b = 0.5 * (static_cast<double>(lo) + hi);
+        result.photonSphereRadius = hiTrace.periapsis;
+        return result;
+    }
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "raylib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Continuous extension of a single integration step.
+//
+// Given the positions and velocities at both ends of a step, the cubic Hermite
+// polynomial through them matches the trajectory to third order, which is at
+// least as accurate as the integrators it is attached to. It lets callers
+// sample a ray anywhere inside a step instead of only at step boundaries.
+struct StepInterpolant
+{
+    double t0 = 0.0, t1 = 0.0;     // Step start and end times (seconds)
+    double x0 = 0.0, y0 = 0.0;     // Start position (pixels)
+    double vx0 = 0.0, vy0 = 0.0;   // Start velocity (pixels per second)
+    double x1 = 0.0, y1 = 0.0;     // End position
+    double vx1 = 0.0, vy1 = 0.0;   // End velocity
+
+    bool Contains(double t) const { return t >= t0 && t <= t1; }
+
+    Vector2 Sample(double t) const
+    {
+        double h = t1 - t0;
+        if (h <= 0.0)
+            return Vector2{static_cast<float>(x1), static_cast<float>(y1)};
+
+        double s = (t - t0) / h;
+        double s2 = s * s, s3 = s2 * s;
+        double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+        double h10 = s3 - 2.0 * s2 + s;
+        double h01 = -2.0 * s3 + 3.0 * s2;
+        double h11 = s3 - s2;
+
+        return Vector2{
+            static_cast<float>(h00 * x0 + h10 * h * vx0 + h01 * x1 + h11 * h * vx1),
+            static_cast<float>(h00 * y0 + h10 * h * vy0 + h01 * y1 + h11 * h * vy1)};
+    }
+};
+
+enum class TrailMode
+{
+    PerStep,   // One point at the end of every integration step
+    Time,      // One point every `spacing` seconds of ray time
+    ArcLength, // One point every `spacing` pixels travelled
+};
+
+// Decides where trail points go, independently of the step size. Each step is
+// handed over as an interpolant; points are emitted wherever the sampling grid
+// falls inside it.
+struct TrailSampler
+{
+    TrailMode mode = TrailMode::PerStep;
+    double spacing = 0.0;
+
+    double lastTime = 0.0; // Time mode: ray time of the last point; a new ray's start point is at 0
+    double arc = 0.0;      // ArcLength mode: distance since the last point
+
+    void Record(const StepInterpolant &step, std::vector<Vector2> &path)
+    {
+        if (mode == TrailMode::PerStep || spacing <= 0.0)
+        {
+            path.push_back(step.Sample(step.t1));
+            return;
+        }
+
+        if (mode == TrailMode::Time)
+        {
+            // The grid runs on from the last point. A point at t0 is already
+            // in the path (the end of the previous step or the start point),
+            // and after a gap the grid restarts from the step's start.
+            double next = lastTime + spacing;
+            if (next <= step.t0)
+                next = step.t0 + spacing;
+            for (; next <= step.t1; next += spacing)
+            {
+                path.push_back(step.Sample(next));
+                lastTime = next;
+            }
+            return;
+        }
+
+        // Walk the curve in pieces a few times finer than the spacing so the
+        // chord lengths add up to the arc length closely enough
+        double chord = std::hypot(step.x1 - step.x0, step.y1 - step.y0);
+        int pieces = std::max(1, static_cast<int>(std::ceil(4.0 * chord / spacing)));
+        Vector2 prev = step.Sample(step.t0);
+        for (int i = 1; i <= pieces; ++i)
+        {
+            double t = step.t0 + (step.t1 - step.t0) * i / pieces;
+            Vector2 p = step.Sample(t);
+            double d = std::hypot(p.x - prev.x, p.y - prev.y);
+
+            // Emit every spacing crossing inside this piece
+            while (arc + d >= spacing && d > 0.0)
+            {
+                double f = (spacing - arc) / d;
+                Vector2 q = {prev.x + static_cast<float>(f) * (p.x - prev.x),
+                             prev.y + static_cast<float>(f) * (p.y - prev.y)};
+                path.push_back(q);
+                d -= spacing - arc;
+                arc = 0.0;
+                prev = q;
+            }
+            arc += d;
+            prev = p;
+        }
+    }
+};
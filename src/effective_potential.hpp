@@ -0,0 +1,121 @@
+#pragma once
+
+#include "physics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+enum class RayOutcome
+{
+    Active,   // Still being integrated
+    Captured, // Crossed the Schwarzschild radius
+    Escaped,  // Left the region of interest moving outwards
+};
+
+// Effective potential of the polar photon equations LightRay integrates.
+//
+// LightRay keeps its speed at c and only turns its direction, by the
+// perpendicular part of the radial acceleration
+//
+//   g(r) = r_s*c²/(2r²) * (1 + 3b²/r²),   b = r*sin(psi)
+//
+// where psi is the angle between the direction and the radius. Along such a
+// path b is not conserved, but d(1/b²)/dr is linear in 1/b², which integrates
+// to the invariant (u = 1/r)
+//
+//   I = exp(-r_s*u) * (u²/sin²(psi) + 3u² + 6u/r_s + 6/r_s²)
+//
+// At a turning point sin(psi) = 1, so V(u) = exp(-r_s*u) * (4u² + 6u/r_s +
+// 6/r_s²) plays the role of the effective potential: a ray can only be where
+// V(u) <= I. V peaks at r = 2 r_s (this integrator's photon sphere), and
+// comparing I with the peak decides a ray's fate long before it reaches the
+// horizon or the edge of the screen. Far from the hole I -> 1/b² + 6/r_s²,
+// which ties it to the impact parameter b.
+//
+// The geodesic atlas and the winding legs work in units of r_s and use an
+// EffectivePotential(1.0).
+struct EffectivePotential
+{
+    double r_s;
+
+    // Relative slack for decisions that depend on I versus the peak, and on
+    // which side of the peak the ray is, to absorb the integrator's drift.
+    // Rays whose I is within it of the peak, about 9% either side of b_crit,
+    // are never decided on I; they stay with the integrator until they are
+    // clearly inside or outside the peak. The decisions are only sound while
+    // the drift along the rest of the path stays below it: along
+    // near-critical orbits at one step per frame or with block steps it is
+    // at most 6e-4, but much coarser steps would need a larger tolerance.
+    double tolerance = 2e-3;
+
+    explicit EffectivePotential(double schwarzschildRadius)
+        : r_s(schwarzschildRadius) {}
+
+    double PeakRadius() const { return 2.0 * r_s; }
+
+    double Potential(double r) const
+    {
+        double u = 1.0 / r;
+        return std::exp(-r_s * u) * (4.0 * u * u + 6.0 * u / r_s + 6.0 / (r_s * r_s));
+    }
+
+    double PeakPotential() const { return Potential(PeakRadius()); }
+
+    double Invariant(double r, double sinPsi) const
+    {
+        double u = 1.0 / r;
+        return std::exp(-r_s * u) * (u * u / (sinPsi * sinPsi) + 3.0 * u * u + 6.0 * u / r_s + 6.0 / (r_s * r_s));
+    }
+
+    // Invariant of the path with impact parameter b, and the inverse.
+    // ImpactParameter is not finite for paths trapped inside the photon sphere.
+    double InvariantOfImpact(double b) const { return 1.0 / (b * b) + 6.0 / (r_s * r_s); }
+    double ImpactParameter(double invariant) const { return 1.0 / std::sqrt(invariant - 6.0 / (r_s * r_s)); }
+    double CriticalImpactParameter() const { return ImpactParameter(PeakPotential()); }
+
+    // sin(psi) where the path with the given invariant passes radius r,
+    // clamped to 1 below its turning point.
+    double SinPsi(double r, double invariant) const
+    {
+        double u = 1.0 / r;
+        double sin2 = u * u / (std::exp(r_s * u) * invariant - 3.0 * u * u - 6.0 * u / r_s - 6.0 / (r_s * r_s));
+        return std::sqrt(std::clamp(sin2, 0.0, 1.0));
+    }
+
+    // Outcome the ray is bound to reach, or Active while it is still open.
+    RayOutcome Classify(double r, double sinPsi, bool outbound) const
+    {
+        double peakRadius = PeakRadius();
+        bool inside = r < peakRadius * (1.0 - tolerance);
+        bool outside = r > peakRadius * (1.0 + tolerance);
+
+        // V falls off on both sides of the peak, so nothing turns a ray
+        // moving away from it
+        if (outbound && outside)
+            return RayOutcome::Escaped;
+        if (!outbound && inside)
+            return RayOutcome::Captured;
+
+        if (sinPsi == 0.0)
+            return outbound ? RayOutcome::Escaped : RayOutcome::Captured; // Radial ray
+
+        double excess = Invariant(r, sinPsi) / PeakPotential() - 1.0;
+        if (excess > tolerance)
+            return outbound ? RayOutcome::Escaped : RayOutcome::Captured; // Clears the barrier
+        if (excess < -tolerance && inside)
+            return RayOutcome::Captured; // Trapped below the barrier, falls back in
+
+        return RayOutcome::Active;
+    }
+
+    // For a ray with pos and dir in pixels, such as LightRay.
+    template <typename Ray>
+    RayOutcome Classify(const Ray &ray) const
+    {
+        double x = ray.pos.x / VIS_SCALE, y = ray.pos.y / VIS_SCALE;
+        double r = std::sqrt(x * x + y * y);
+        double sinPsi = std::abs(x * ray.dir.y - y * ray.dir.x) / r;
+        bool outbound = x * ray.dir.x + y * ray.dir.y > 0.0;
+        return Classify(r, sinPsi, outbound);
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+
+// Analytic weak-field leg for a light ray far from the black hole.
+//
+// Far away (r >> r_s) a ray travels along an almost straight line with impact
+// parameter b. Expanding the equations LightRay integrates to first order in
+// r_s/b, the bending accumulated along that line has a closed form in terms of
+// the signed arc length s measured from the point of closest approach:
+//
+//   sigma(s) = s / sqrt(s² + b²)
+//   theta(s) = r_s/(2b) * (k*sigma + sigma*(3 - sigma²))     (direction change)
+//   F(s)     = r_s/(2b) * (k*rho + 2*rho - b²/rho)          (integral of theta)
+//
+// with rho = sqrt(s² + b²). The sigma*(3 - sigma²) part is the photon term
+// -3*r_s*L²/(2r⁴) and k*sigma the Newtonian -r_s*c²/(2r²) term of the polar
+// kernel. Over a full pass they sum to the familiar (2 + k)*r_s/b deflection.
+//
+// A leg is solved once when a ray enters the far zone: it runs from the ray's
+// current position to the point where the line crosses the zone boundary (or
+// to infinity for rays that never re-enter). While on the leg the ray is
+// advanced by evaluating the closed form, which needs one sqrt and no trig.
+struct FarFieldLeg
+{
+    bool active = false;
+
+    double x0 = 0.0, y0 = 0.0; // Start position (meters)
+    double dx = 1.0, dy = 0.0; // Start direction (unit)
+    double nx = 0.0, ny = 0.0; // Unit normal from the line towards the hole
+    double b = 0.0;            // Impact parameter of the straight line (meters)
+    double k = 1.0;            // Weight of the Newtonian term (see above)
+    double r_s = 0.0;
+
+    double s0 = 0.0;   // Arc position of the start point
+    double s = 0.0;    // Current arc position
+    double sEnd = 0.0; // Arc position of the zone boundary (infinity if none)
+
+    double theta0 = 0.0, F0 = 0.0;
+
+    // Solves the leg for a ray at (x, y) heading along unit (dirX, dirY), in
+    // meters relative to the hole. Returns an inactive leg if the ray is
+    // inside the zone of the given radius.
+    static FarFieldLeg Solve(double x, double y, double dirX, double dirY,
+                             double r_s, double radius, double k = 1.0)
+    {
+        FarFieldLeg leg;
+
+        double r2 = x * x + y * y;
+        if (radius <= 0.0 || r2 <= radius * radius)
+            return leg;
+
+        leg.active = true;
+        leg.x0 = x;
+        leg.y0 = y;
+        leg.dx = dirX;
+        leg.dy = dirY;
+        leg.k = k;
+        leg.r_s = r_s;
+
+        // Closest point of the straight line to the hole
+        leg.s0 = x * dirX + y * dirY;
+        double px = x - leg.s0 * dirX;
+        double py = y - leg.s0 * dirY;
+        leg.b = std::sqrt(px * px + py * py);
+        if (leg.b > 0.0)
+        {
+            leg.nx = -px / leg.b;
+            leg.ny = -py / leg.b;
+        }
+
+        leg.s = leg.s0;
+        leg.sEnd = std::numeric_limits<double>::infinity();
+        if (leg.s0 < 0.0 && leg.b < radius)
+            leg.sEnd = -std::sqrt(radius * radius - leg.b * leg.b); // Inbound: stop at the boundary
+
+        leg.theta0 = leg.Theta(leg.s0);
+        leg.F0 = leg.F(leg.s0);
+        return leg;
+    }
+
+    double Theta(double arc) const
+    {
+        if (b <= 0.0)
+            return 0.0; // Radial ray, no bending
+
+        double sigma = arc / std::sqrt(arc * arc + b * b);
+        return r_s / (2.0 * b) * (k * sigma + sigma * (3.0 - sigma * sigma));
+    }
+
+    double F(double arc) const
+    {
+        if (b <= 0.0)
+            return 0.0;
+
+        double rho = std::sqrt(arc * arc + b * b);
+        return r_s / (2.0 * b) * (k * rho + 2.0 * rho - b * b / rho);
+    }
+
+    // Moves the ray `distance` meters along the leg. Returns the distance left
+    // over after reaching the zone boundary; the leg is then inactive.
+    double Advance(double distance)
+    {
+        double remaining = 0.0;
+        s += distance;
+        if (s >= sEnd)
+        {
+            remaining = s - sEnd;
+            s = sEnd;
+            active = false;
+        }
+        return remaining;
+    }
+
+    // Current position (meters) and unit direction on the leg.
+    void Evaluate(double &x, double &y, double &dirX, double &dirY) const
+    {
+        double ds = s - s0;
+        double offset = F(s) - F0 - theta0 * ds; // Sideways drift towards the hole
+        double bend = Theta(s) - theta0;         // Accumulated direction change
+
+        x = x0 + dx * ds + nx * offset;
+        y = y0 + dy * ds + ny * offset;
+
+        double vx = dx + nx * bend;
+        double vy = dy + ny * bend;
+        double len = std::sqrt(vx * vx + vy * vy);
+        dirX = vx / len;
+        dirY = vy / len;
+    }
+};
@@ -0,0 +1,502 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "cartesian_kernel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Inlines every call made inside the function, all the way down. GCC and
+// Clang only; MSVC has no such attribute and warns about unknown ones.
+#if defined(__GNUC__) || defined(__clang__)
+#define FLATTEN [[gnu::flatten]]
+#else
+#define FLATTEN
+#endif
+
+// Calls fn(std::integral_constant<int, I>{}) for I = 0 .. N-1. The calls are
+// expanded at compile time, so loops over tensor indices written with it
+// become straight-line code whatever the optimizer's unrolling limits.
+// Multi-index loops are flattened into one Unroll over a combined index.
+template <int N, typename Fn>
+inline void Unroll(Fn &&fn)
+{
+    [&]<int... I>(std::integer_sequence<int, I...>) { (fn(std::integral_constant<int, I>{}), ...); }(
+        std::make_integer_sequence<int, N>{});
+}
+
+// Forward-mode dual number: a value and its derivatives along N seed
+// directions, all carried through every operation at once.
+template <typename T, int N>
+struct Dual
+{
+    T v;    // Value
+    T d[N]; // Partial derivatives
+
+    constexpr Dual(T value = T(0)) : v(value), d{} {}
+
+    // The i-th independent variable.
+    static constexpr Dual Variable(T value, int i)
+    {
+        Dual r(value);
+        r.d[i] = T(1);
+        return r;
+    }
+
+    // Dual with value v and derivatives scale * a.d.
+    static constexpr Dual Chain(T v, T scale, const Dual &a)
+    {
+        Dual r(v);
+        Unroll<N>([&](auto i) { r.d[i] = scale * a.d[i]; });
+        return r;
+    }
+};
+
+template <typename T, int N>
+constexpr Dual<T, N> operator-(const Dual<T, N> &a)
+{
+    return Dual<T, N>::Chain(-a.v, T(-1), a);
+}
+
+template <typename T, int N>
+constexpr Dual<T, N> operator+(const Dual<T, N> &a, const Dual<T, N> &b)
+{
+    Dual<T, N> r(a.v + b.v);
+    Unroll<N>([&](auto i) { r.d[i] = a.d[i] + b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+constexpr Dual<T, N> operator-(const Dual<T, N> &a, const Dual<T, N> &b)
+{
+    Dual<T, N> r(a.v - b.v);
+    Unroll<N>([&](auto i) { r.d[i] = a.d[i] - b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+constexpr Dual<T, N> operator*(const Dual<T, N> &a, const Dual<T, N> &b)
+{
+    Dual<T, N> r(a.v * b.v);
+    Unroll<N>([&](auto i) { r.d[i] = a.d[i] * b.v + a.v * b.d[i]; });
+    return r;
+}
+
+template <typename T, int N>
+constexpr Dual<T, N> operator/(const Dual<T, N> &a, const Dual<T, N> &b)
+{
+    T inv = T(1) / b.v;
+    Dual<T, N> r(a.v * inv);
+    Unroll<N>([&](auto i) { r.d[i] = (a.d[i] - r.v * b.d[i]) * inv; });
+    return r;
+}
+
+// Mixed with plain numbers (constants of the metric)
+template <typename T, int N>
+constexpr Dual<T, N> operator+(const Dual<T, N> &a, T b)
+{
+    Dual<T, N> r = a;
+    r.v += b;
+    return r;
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator+(T a, const Dual<T, N> &b)
+{
+    return b + a;
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator-(const Dual<T, N> &a, T b)
+{
+    return a + (-b);
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator-(T a, const Dual<T, N> &b)
+{
+    return -b + a;
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator*(const Dual<T, N> &a, T b)
+{
+    return Dual<T, N>::Chain(a.v * b, b, a);
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator*(T a, const Dual<T, N> &b)
+{
+    return b * a;
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator/(const Dual<T, N> &a, T b)
+{
+    return a * (T(1) / b);
+}
+template <typename T, int N>
+constexpr Dual<T, N> operator/(T a, const Dual<T, N> &b)
+{
+    T inv = T(1) / b.v;
+    return Dual<T, N>::Chain(a * inv, -a * inv * inv, b);
+}
+
+template <typename T, int N>
+Dual<T, N> sqrt(const Dual<T, N> &a)
+{
+    T s = std::sqrt(a.v);
+    return Dual<T, N>::Chain(s, T(0.5) / s, a);
+}
+template <typename T, int N>
+Dual<T, N> sin(const Dual<T, N> &a)
+{
+    return Dual<T, N>::Chain(std::sin(a.v), std::cos(a.v), a);
+}
+template <typename T, int N>
+Dual<T, N> cos(const Dual<T, N> &a)
+{
+    return Dual<T, N>::Chain(std::cos(a.v), -std::sin(a.v), a);
+}
+template <typename T, int N>
+Dual<T, N> exp(const Dual<T, N> &a)
+{
+    T e = std::exp(a.v);
+    return Dual<T, N>::Chain(e, e, a);
+}
+template <typename T, int N>
+Dual<T, N> log(const Dual<T, N> &a)
+{
+    return Dual<T, N>::Chain(std::log(a.v), T(1) / a.v, a);
+}
+
+template <typename S>
+using MetricTensor = std::array<std::array<S, 4>, 4>;
+
+// Inverse of a 4x4 matrix by cofactors: straight-line, no pivoting
+// branches. Returns the determinant.
+inline double Invert4(const MetricTensor<double> &m, MetricTensor<double> &inv)
+{
+    double s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1], s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+    double s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3], s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+    double s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3], s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+    double c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3], c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    double c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2], c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    double c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2], c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+    double det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    double id = 1.0 / det;
+
+    inv[0][0] = (m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * id;
+    inv[0][1] = (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * id;
+    inv[0][2] = (m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * id;
+    inv[0][3] = (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * id;
+    inv[1][0] = (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * id;
+    inv[1][1] = (m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * id;
+    inv[1][2] = (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * id;
+    inv[1][3] = (m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * id;
+    inv[2][0] = (m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * id;
+    inv[2][1] = (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * id;
+    inv[2][2] = (m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * id;
+    inv[2][3] = (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * id;
+    inv[3][0] = (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * id;
+    inv[3][1] = (m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * id;
+    inv[3][2] = (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * id;
+    inv[3][3] = (m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * id;
+    return det;
+}
+
+// Geodesics of any metric, given only g_μν(x).
+//
+// Metric is a function object templated on the scalar type:
+//
+//   template <typename S> MetricTensor<S> operator()(const std::array<S, 4> &x) const
+//
+// written with ordinary arithmetic (and unqualified sqrt, sin, ... after
+// `using std::sqrt;`). Evaluating it once on dual numbers seeded with the four
+// coordinates yields g and every ∂_k g_μν, from which the geodesic
+// acceleration follows without forming the Christoffel symbols:
+//
+//   d²x^μ/dλ² = -Γ^μ_αβ u^α u^β = -g^μν (∂_α g_νβ - ½ ∂_ν g_αβ) u^α u^β.
+//
+// Everything is inlined into the step and every index loop is unrolled, so
+// each metric compiles to its own straight-line kernel. Steps are classical
+// RK4 in the affine parameter; the acceleration depends on u, which rules out
+// the kick-drift-kick scheme of the Cartesian kernel.
+template <typename Metric>
+struct GenericGeodesic
+{
+    using Vec = std::array<double, 4>;
+    using D = Dual<double, 4>;
+
+    Metric metric;
+
+    // g at x, with ∂_k g_μν in g[μ][ν].d[k].
+    MetricTensor<D> Evaluate(const Vec &x) const
+    {
+        std::array<D, 4> seeded;
+        Unroll<4>([&](auto i) { seeded[i] = D::Variable(x[i], i); });
+        return metric(seeded);
+    }
+
+    FLATTEN Vec Acceleration(const Vec &x, const Vec &u) const
+    {
+        MetricTensor<D> g = Evaluate(x);
+
+        // w_ν = (∂_α g_νβ - ½ ∂_ν g_αβ) u^α u^β. Each loop is a single flat
+        // Unroll: the compiler inlines small bodies reliably, nested lambdas not
+        double uu[4][4];
+        Unroll<16>([&](auto i) { uu[i / 4][i % 4] = u[i / 4] * u[i % 4]; });
+        Vec w{};
+        Unroll<64>(
+            [&](auto i)
+            {
+                constexpr int n = i / 16, a = i / 4 % 4, b = i % 4;
+                w[n] += (g[n][b].d[a] - 0.5 * g[a][b].d[n]) * uu[a][b];
+            });
+
+        MetricTensor<double> value, inverse;
+        Unroll<16>([&](auto i) { value[i / 4][i % 4] = g[i / 4][i % 4].v; });
+        Invert4(value, inverse);
+
+        Vec acc{};
+        Unroll<16>([&](auto i) { acc[i / 4] -= inverse[i / 4][i % 4] * w[i % 4]; });
+        return acc;
+    }
+
+    // Sets u[0] so that u is null and future directed, given its spatial part.
+    void NullLaunch(const Vec &x, Vec &u) const
+    {
+        MetricTensor<D> g = Evaluate(x);
+        double a = g[0][0].v, b = 0.0, c = 0.0;
+        Unroll<3>([&](auto i) { b += 2.0 * g[0][i + 1].v * u[i + 1]; });
+        Unroll<9>([&](auto i) { c += g[i / 3 + 1][i % 3 + 1].v * u[i / 3 + 1] * u[i % 3 + 1]; });
+        // a ut² + b ut + c = 0 with a < 0 outside the horizon; the positive root
+        u[0] = (-b - std::sqrt(b * b - 4.0 * a * c)) / (2.0 * a);
+    }
+
+    // g_μν u^μ u^ν; zero along a null geodesic up to the integration error.
+    double Norm(const Vec &x, const Vec &u) const
+    {
+        MetricTensor<D> g = Evaluate(x);
+        double s = 0.0;
+        Unroll<16>([&](auto i) { s += g[i / 4][i % 4].v * u[i / 4] * u[i % 4]; });
+        return s;
+    }
+
+    void Step(Vec &x, Vec &u, double h) const
+    {
+        auto axpy = [](const Vec &a, double s, const Vec &b)
+        {
+            Vec r;
+            Unroll<4>([&](auto i) { r[i] = a[i] + s * b[i]; });
+            return r;
+        };
+
+        Vec a1 = Acceleration(x, u);
+        Vec x2 = axpy(x, 0.5 * h, u), u2 = axpy(u, 0.5 * h, a1);
+        Vec a2 = Acceleration(x2, u2);
+        Vec x3 = axpy(x, 0.5 * h, u2), u3 = axpy(u, 0.5 * h, a2);
+        Vec a3 = Acceleration(x3, u3);
+        Vec x4 = axpy(x, h, u3), u4 = axpy(u, h, a3);
+        Vec a4 = Acceleration(x4, u4);
+
+        Unroll<4>(
+            [&](auto i)
+            {
+                x[i] += h / 6.0 * (u[i] + 2.0 * u2[i] + 2.0 * u3[i] + u4[i]);
+                u[i] += h / 6.0 * (a1[i] + 2.0 * a2[i] + 2.0 * a3[i] + a4[i]);
+            });
+    }
+};
+
+// Schwarzschild in Schwarzschild coordinates (t, r, θ, φ), r_s = 1. The
+// example for GenericGeodesic and what MetricBenchmark checks it with.
+struct SchwarzschildCoordinates
+{
+    template <typename S>
+    MetricTensor<S> operator()(const std::array<S, 4> &x) const
+    {
+        using std::sin;
+        S r = x[1];
+        S f = 1.0 - 1.0 / r;
+        S s = sin(x[2]);
+        MetricTensor<S> g{};
+        g[0][0] = -f;
+        g[1][1] = 1.0 / f;
+        g[2][2] = r * r;
+        g[3][3] = r * r * s * s;
+        return g;
+    }
+};
+
+// Times the generic engine on SchwarzschildCoordinates against the
+// specialized Cartesian kernel, tracing the same fan of rays through the
+// equatorial plane at a range of step accuracies. Both use the same
+// adaptive rule (step proportional to r - 1) and are scored by the error in
+// the final direction against the exact one from the orbit integral
+// (Reference), which shares no code with either integrator.
+// The Cartesian side is the scalar double-precision CartesianState, so the
+// comparison is per ray, leaving the batched kernels' SIMD out of it.
+struct MetricBenchmark
+{
+    double distance = 500.0; // Launch and escape radius (r_s)
+    int rays = 64;
+    std::vector<double> accuracies = {0.2, 0.1, 0.05, 0.02, 0.01, 0.005, 0.002};
+
+    struct Result
+    {
+        double accuracy;
+        double seconds; // For the whole fan
+        long steps;
+        double error;   // Mean |direction error| (rad)
+    };
+
+    // Impact parameters from just above critical out to 20 r_s.
+    double Impact(int i) const { return 2.7 + (20.0 - 2.7) * i / std::max(1, rays - 1); }
+
+    // Direction of flight at the end, or NaN if captured.
+    double TraceCartesian(double b, double accuracy, long &steps) const
+    {
+        CartesianState s;
+        s.Init(-distance, b, 1.0, 0.0);
+        for (;;)
+        {
+            double r = s.Radius();
+            if (r < 1.0)
+                return NAN;
+            if (r > distance && s.x * s.vx + s.y * s.vy > 0.0)
+                return std::atan2(s.vy, s.vx);
+            s.Step(std::clamp(accuracy * (r - 1.0), 1e-4, 50.0));
+            ++steps;
+        }
+    }
+
+    double TraceGeneric(double b, double accuracy, long &steps) const
+    {
+        GenericGeodesic<SchwarzschildCoordinates> engine;
+        double r0 = std::hypot(distance, b), phi0 = std::atan2(b, -distance);
+        std::array<double, 4> x{0.0, r0, 0.5 * PI, phi0};
+        // Unit-speed Cartesian direction (1, 0) in the local (r, φ) frame
+        std::array<double, 4> u{0.0, std::cos(phi0), 0.0, -std::sin(phi0) / r0};
+        engine.NullLaunch(x, u);
+        for (;;)
+        {
+            double r = x[1];
+            if (r < 1.0)
+                return NAN;
+            if (r > distance && u[1] > 0.0)
+            {
+                double vx = u[1] * std::cos(x[3]) - r * u[3] * std::sin(x[3]);
+                double vy = u[1] * std::sin(x[3]) + r * u[3] * std::cos(x[3]);
+                return std::atan2(vy, vx);
+            }
+            engine.Step(x, u, std::clamp(accuracy * (r - 1.0), 1e-4, 50.0));
+            ++steps;
+        }
+    }
+
+    // Exact direction of flight at r = distance, or NaN if captured. With
+    // u = 1/r the orbit obeys (du/dφ)² = G(u) = C - u² + u³, where launching
+    // parallel to the x axis from (-distance, b) gives C = 1/b² - u0³. The
+    // ray turns by the integral of du / sqrt(G) in to the turning point ut
+    // and back out. Writing G = (ut - u) P(u) and u = ut - w² makes that
+    // 2 dw / sqrt(P), which is smooth, so plain Simpson's rule converges
+    // to round-off.
+    double Reference(double b) const
+    {
+        double u0 = 1.0 / std::hypot(distance, b), u1 = 1.0 / distance;
+        double C = 1.0 / (b * b) - u0 * u0 * u0;
+        auto G = [&](double u) { return C - u * u + u * u * u; };
+        if (G(2.0 / 3.0) >= 0.0)
+            return NAN; // No turning point outside the photon sphere
+
+        // G falls monotonically from u0 to the photon sphere
+        double lo = u0, hi = 2.0 / 3.0;
+        for (int i = 0; i < 200; ++i)
+            (G(0.5 * (lo + hi)) > 0.0 ? lo : hi) = 0.5 * (lo + hi);
+        double ut = 0.5 * (lo + hi);
+
+        auto turn = [&](double from)
+        {
+            auto f = [&](double w)
+            {
+                double u = ut - w * w;
+                return 2.0 / std::sqrt(ut - ut * ut + (1.0 - ut) * u - u * u);
+            };
+            const int n = 20000; // Even
+            double top = std::sqrt(ut - from), h = top / n, sum = f(0.0) + f(top);
+            for (int i = 1; i < n; ++i)
+                sum += (i % 2 ? 4.0 : 2.0) * f(i * h);
+            return sum * h / 3.0;
+        };
+
+        // φ falls along the orbit; at the exit r dφ/dr = -u / sqrt(G)
+        double phi = std::atan2(b, -distance) - turn(u0) - turn(u1);
+        return phi + std::atan2(-u1, std::sqrt(G(u1)));
+    }
+
+    template <typename Trace>
+    std::vector<Result> Measure(Trace &&trace, const std::vector<double> &reference) const
+    {
+        std::vector<Result> results;
+        for (double accuracy : accuracies)
+        {
+            Result result{accuracy, 0.0, 0, 0.0};
+            auto start = std::chrono::steady_clock::now();
+            int counted = 0;
+            for (int i = 0; i < rays; ++i)
+            {
+                double angle = trace(Impact(i), accuracy, result.steps);
+                if (std::isnan(angle) || std::isnan(reference[i]))
+                    continue;
+                result.error += std::abs(std::remainder(angle - reference[i], 2.0 * PI));
+                ++counted;
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.error /= std::max(1, counted);
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    void Run(std::ostream &out) const
+    {
+        std::vector<double> reference(rays);
+        for (int i = 0; i < rays; ++i)
+            reference[i] = Reference(Impact(i));
+
+        auto cartesian = Measure([&](double b, double a, long &n) { return TraceCartesian(b, a, n); }, reference);
+        auto generic = Measure([&](double b, double a, long &n) { return TraceGeneric(b, a, n); }, reference);
+
+        out << "accuracy   cartesian: steps   error      ms   |   generic (AD): steps   error      ms\n";
+        for (size_t i = 0; i < accuracies.size(); ++i)
+        {
+            char line[160];
+            std::snprintf(line, sizeof(line), "%8.4f  %17ld  %8.1e  %6.2f  |  %19ld  %8.1e  %6.2f\n", accuracies[i],
+                          cartesian[i].steps, cartesian[i].error, 1e3 * cartesian[i].seconds, generic[i].steps,
+                          generic[i].error, 1e3 * generic[i].seconds);
+            out << line;
+        }
+
+        // The price of generality where it matters: wall time to a given error
+        for (double tolerance : {1e-4, 1e-6})
+        {
+            auto cheapest = [&](const std::vector<Result> &results)
+            {
+                double best = INFINITY;
+                for (const Result &result : results)
+                    if (result.error <= tolerance)
+                        best = std::min(best, result.seconds);
+                return best;
+            };
+            double c = cheapest(cartesian), g = cheapest(generic);
+            char line[160];
+            std::snprintf(line, sizeof(line), "error <= %.0e: cartesian %.2f ms, generic %.2f ms (%.1fx)\n", tolerance,
+                          1e3 * c, 1e3 * g, g / c);
+            out << line;
+        }
+    }
+};
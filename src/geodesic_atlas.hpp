@@ -0,0 +1,313 @@
+#pragma once
+
+#include "effective_potential.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// One canonical trajectory of the atlas, in units of r_s. It starts on the
+// outer radius moving inwards with the hole on its left, and is sampled at
+// a fixed arc length spacing until it is captured or leaves again.
+struct AtlasCurve
+{
+    double b = 0.0;         // Impact parameter at infinity
+    std::vector<float> x, y; // Samples, `spacing` apart along the curve
+    size_t periapsis = 0;   // Index of the closest approach (last index if captured)
+    bool captured = false;
+};
+
+// Where a ray sits on the atlas: the two curves bracketing its impact
+// parameter, the arc position it started at on each, and the rotation that
+// carries each canonical curve onto the ray.
+struct AtlasTrack
+{
+    bool active = false;
+
+    const AtlasCurve *lo = nullptr, *hi = nullptr;
+    double weight = 0.0;         // Blend towards `hi`
+    double s0Lo = 0.0, s0Hi = 0.0; // Start arc positions (r_s)
+    double cosLo = 1.0, sinLo = 0.0, cosHi = 1.0, sinHi = 0.0;
+    bool mirrored = false;       // Ray turns clockwise: reflect y
+    double s = 0.0;              // Arc length travelled since placement (r_s)
+};
+
+// Precomputed atlas of the photon paths LightRay follows.
+//
+// The polar equations only bend a ray by a curvature that depends on r/r_s and
+// the angle between direction and radius, so up to rotation, reflection and
+// scaling by r_s every path is fixed by the invariant of EffectivePotential,
+// or equivalently by the impact parameter b at infinity. The atlas integrates
+// that one-parameter family once and afterwards places any ray by computing
+// its b, looking up the two neighbouring curves and the arc position on them
+// (O(1) plus a binary search on the radius) and from then on moves it by
+// reading, rotating and blending curve samples instead of integrating.
+//
+// Curves are spaced logarithmically in |b - b_crit| to resolve the windings
+// near the photon sphere. Rays the atlas cannot represent -- outside the outer
+// radius, trapped inside the photon sphere, too close to b_crit, or leaving on
+// the capture side -- are left to the integrator.
+struct GeodesicAtlas
+{
+    double outerRadius = 32.0;   // r_s; rays start and escape here
+    double spacing = 0.05;       // Arc length between samples (r_s)
+    int curvesPerSide = 128;     // Curves below and above b_crit
+    double closest = 1e-6;       // Smallest |b - b_crit| / b_crit in the atlas
+    size_t maxSamples = 20000;
+
+    std::vector<AtlasCurve> captureSide, escapeSide; // Ordered by growing |b - b_crit|
+
+    EffectivePotential potential{1.0};
+
+    bool Built() const { return !escapeSide.empty(); }
+
+    void Build(unsigned threads = 0)
+    {
+        captureSide.assign(curvesPerSide, AtlasCurve{});
+        escapeSide.assign(curvesPerSide, AtlasCurve{});
+
+        double bc = potential.CriticalImpactParameter();
+        ParallelFor(2 * static_cast<size_t>(curvesPerSide), [&](size_t i)
+                    {
+                        bool escape = i >= static_cast<size_t>(curvesPerSide);
+                        int k = static_cast<int>(i % curvesPerSide);
+                        double offset = bc * std::exp(Logarithm(k, escape));
+                        AtlasCurve &curve = escape ? escapeSide[k] : captureSide[k];
+                        curve.b = escape ? bc + offset : std::max(bc - offset, 0.0);
+                        Trace(curve); },
+                    threads);
+    }
+
+    // Places a ray at (x, y) with unit direction (dx, dy), in units of r_s.
+    bool Place(double x, double y, double dx, double dy, AtlasTrack &track) const
+    {
+        track.active = false;
+        if (!Built())
+            return false;
+
+        double r = std::sqrt(x * x + y * y);
+        if (r >= outerRadius || r <= 1.0)
+            return false;
+
+        // Canonical curves turn counter-clockwise
+        track.mirrored = x * dy - y * dx < 0.0;
+        if (track.mirrored)
+        {
+            y = -y;
+            dy = -dy;
+        }
+
+        double sinPsi = (x * dy - y * dx) / r;
+        if (sinPsi <= 0.0)
+            return false; // Radial
+
+        double b = potential.ImpactParameter(potential.Invariant(r, sinPsi));
+        if (!std::isfinite(b))
+            return false; // Trapped inside the photon sphere
+
+        double bc = potential.CriticalImpactParameter();
+        bool escape = b > bc;
+        bool outbound = x * dx + y * dy > 0.0;
+        if (!escape && outbound)
+            return false;
+
+        double f = Index(std::abs(b - bc) / bc, escape);
+        if (f < 0.0 || f > curvesPerSide - 1)
+            return false;
+
+        const std::vector<AtlasCurve> &side = escape ? escapeSide : captureSide;
+        int k = std::min(static_cast<int>(f), curvesPerSide - 2);
+        track.lo = &side[k];
+        track.hi = &side[k + 1];
+        track.weight = f - k;
+
+        double angle = std::atan2(y, x);
+        if (!Anchor(*track.lo, r, outbound, angle, track.s0Lo, track.cosLo, track.sinLo) ||
+            !Anchor(*track.hi, r, outbound, angle, track.s0Hi, track.cosHi, track.sinHi))
+            return false;
+
+        track.s = 0.0;
+        track.active = true;
+        return true;
+    }
+
+    // Position and unit direction after moving `track.s` along the curves.
+    // Returns false once the ray runs off the end of either curve.
+    bool Evaluate(const AtlasTrack &track, double &x, double &y, double &dx, double &dy) const
+    {
+        double xl, yl, dxl, dyl, xh, yh, dxh, dyh;
+        if (!Sample(*track.lo, track.s0Lo + track.s, track.cosLo, track.sinLo, xl, yl, dxl, dyl) ||
+            !Sample(*track.hi, track.s0Hi + track.s, track.cosHi, track.sinHi, xh, yh, dxh, dyh))
+            return false;
+
+        double w = track.weight;
+        x = xl + w * (xh - xl);
+        y = yl + w * (yh - yl);
+        dx = dxl + w * (dxh - dxl);
+        dy = dyl + w * (dyh - dyl);
+        double len = std::sqrt(dx * dx + dy * dy);
+        dx /= len;
+        dy /= len;
+
+        if (track.mirrored)
+        {
+            y = -y;
+            dy = -dy;
+        }
+        return true;
+    }
+
+    // Whether the curves of a finished track were captured.
+    static bool Captured(const AtlasTrack &track) { return track.lo->captured; }
+
+private:
+    double Logarithm(int k, bool escape) const
+    {
+        double lo = std::log(closest);
+        double bc = potential.CriticalImpactParameter();
+        double hi = escape ? std::log((0.9 * outerRadius - bc) / bc) : 0.0;
+        return lo + (hi - lo) * k / (curvesPerSide - 1);
+    }
+
+    double Index(double offset, bool escape) const
+    {
+        double lo = Logarithm(0, escape), hi = Logarithm(curvesPerSide - 1, escape);
+        return (std::log(offset) - lo) / (hi - lo) * (curvesPerSide - 1);
+    }
+
+    // Integrates one curve with RK4 on the continuous equations: unit speed,
+    // turned by the perpendicular part of g = (1 + 3 sin²psi) / (2r²).
+    void Trace(AtlasCurve &curve) const
+    {
+        double R = outerRadius;
+        double sinPsi = potential.SinPsi(R, potential.InvariantOfImpact(curve.b));
+
+        double state[4] = {-R, 0.0, std::sqrt(1.0 - sinPsi * sinPsi), -sinPsi};
+        auto derivative = [](const double *s, double *d)
+        {
+            double r2 = s[0] * s[0] + s[1] * s[1];
+            double r = std::sqrt(r2);
+            double cross = s[0] * s[3] - s[1] * s[2];
+            double g = (1.0 + 3.0 * cross * cross / r2) / (2.0 * r2);
+            double ax = -g * s[0] / r, ay = -g * s[1] / r;
+            double along = ax * s[2] + ay * s[3];
+            d[0] = s[2];
+            d[1] = s[3];
+            d[2] = ax - along * s[2];
+            d[3] = ay - along * s[3];
+        };
+
+        const int substeps = 4;
+        const double h = spacing / substeps;
+        double minR = R;
+
+        curve.x.push_back(static_cast<float>(state[0]));
+        curve.y.push_back(static_cast<float>(state[1]));
+        while (curve.x.size() < maxSamples)
+        {
+            for (int n = 0; n < substeps; ++n)
+            {
+                double k1[4], k2[4], k3[4], k4[4], tmp[4];
+                derivative(state, k1);
+                for (int i = 0; i < 4; ++i)
+                    tmp[i] = state[i] + 0.5 * h * k1[i];
+                derivative(tmp, k2);
+                for (int i = 0; i < 4; ++i)
+                    tmp[i] = state[i] + 0.5 * h * k2[i];
+                derivative(tmp, k3);
+                for (int i = 0; i < 4; ++i)
+                    tmp[i] = state[i] + h * k3[i];
+                derivative(tmp, k4);
+                for (int i = 0; i < 4; ++i)
+                    state[i] += h / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+            }
+
+            curve.x.push_back(static_cast<float>(state[0]));
+            curve.y.push_back(static_cast<float>(state[1]));
+
+            double r = std::sqrt(state[0] * state[0] + state[1] * state[1]);
+            if (r < minR)
+            {
+                minR = r;
+                curve.periapsis = curve.x.size() - 1;
+            }
+            if (r <= 1.0)
+            {
+                curve.captured = true;
+                break;
+            }
+            if (r > R)
+                break;
+        }
+        if (curve.captured)
+            curve.periapsis = curve.x.size() - 1;
+    }
+
+    double Radius(const AtlasCurve &curve, size_t i) const
+    {
+        return std::sqrt(static_cast<double>(curve.x[i]) * curve.x[i] + static_cast<double>(curve.y[i]) * curve.y[i]);
+    }
+
+    // Finds the arc position where the curve passes radius r on the inbound
+    // or outbound branch, and the rotation taking that point to `angle`.
+    bool Anchor(const AtlasCurve &curve, double r, bool outbound, double angle,
+                double &s0, double &cosA, double &sinA) const
+    {
+        size_t first = outbound ? curve.periapsis : 0;
+        size_t last = outbound ? curve.x.size() - 1 : curve.periapsis;
+        if (outbound && curve.captured)
+            return false;
+
+        // Radius is monotonic on each branch: decreasing in, increasing out
+        auto beyond = [&](size_t i)
+        { return outbound ? Radius(curve, i) >= r : Radius(curve, i) <= r; };
+
+        size_t lo = first, hi = last;
+        if (!beyond(hi))
+            return false;
+        if (beyond(lo))
+            hi = lo;
+        while (hi - lo > 1)
+        {
+            size_t mid = (lo + hi) / 2;
+            (beyond(mid) ? hi : lo) = mid;
+        }
+
+        double t = 0.0;
+        if (hi != lo)
+        {
+            double rl = Radius(curve, lo), rh = Radius(curve, hi);
+            t = rh != rl ? std::clamp((r - rl) / (rh - rl), 0.0, 1.0) : 0.0;
+        }
+        s0 = (lo + t) * spacing;
+
+        double px = curve.x[lo] + t * (curve.x[hi] - curve.x[lo]);
+        double py = curve.y[lo] + t * (curve.y[hi] - curve.y[lo]);
+        double rotation = angle - std::atan2(py, px);
+        cosA = std::cos(rotation);
+        sinA = std::sin(rotation);
+        return true;
+    }
+
+    bool Sample(const AtlasCurve &curve, double s, double cosA, double sinA,
+                double &x, double &y, double &dx, double &dy) const
+    {
+        double f = s / spacing;
+        size_t i = static_cast<size_t>(f);
+        if (i + 1 >= curve.x.size())
+            return false;
+
+        double t = f - i;
+        double px = curve.x[i] + t * (curve.x[i + 1] - curve.x[i]);
+        double py = curve.y[i] + t * (curve.y[i + 1] - curve.y[i]);
+        double tx = curve.x[i + 1] - curve.x[i];
+        double ty = curve.y[i + 1] - curve.y[i];
+
+        x = cosA * px - sinA * py;
+        y = sinA * px + cosA * py;
+        dx = cosA * tx - sinA * ty;
+        dy = sinA * tx + cosA * ty;
+        return true;
+    }
+};
@@ -0,0 +1,994 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "cartesian_kernel.hpp"
+#include "parallel.hpp"
+#include "sky_texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Pinhole camera looking at the hole, which sits at the origin with the
+// accretion disk in the z = 0 plane. Lengths are in r_s.
+struct LensCamera
+{
+    int width = 800, height = 450;
+    double distance = 20.0;    // From the hole
+    double inclination = 0.15; // Radians above the disk plane
+    double azimuth = 0.0;      // Radians around the z axis
+    double fov = 1.0;          // Vertical field of view (radians)
+
+    Vector3 Position() const
+    {
+        return Vector3{static_cast<float>(distance * std::cos(inclination) * std::cos(azimuth)),
+                       static_cast<float>(distance * std::cos(inclination) * std::sin(azimuth)),
+                       static_cast<float>(distance * std::sin(inclination))};
+    }
+
+    // Forward, right and up unit vectors of the view.
+    void Basis(Vector3 &forward, Vector3 &right, Vector3 &up) const
+    {
+        forward = Vector3Normalize(Vector3Scale(Position(), -1.0f));
+        Vector3 worldUp = std::abs(forward.z) > 0.999f ? Vector3{0, 1, 0} : Vector3{0, 0, 1};
+        right = Vector3Normalize(Vector3CrossProduct(forward, worldUp));
+        up = Vector3CrossProduct(right, forward);
+    }
+
+    // Unit direction through the centre of pixel (px, py).
+    Vector3 Direction(double px, double py) const
+    {
+        Vector3 forward, right, up;
+        Basis(forward, right, up);
+
+        double scale = std::tan(0.5 * fov);
+        double aspect = static_cast<double>(width) / height;
+        float sx = static_cast<float>((2.0 * (px + 0.5) / width - 1.0) * scale * aspect);
+        float sy = static_cast<float>((1.0 - 2.0 * (py + 0.5) / height) * scale);
+        return Vector3Normalize(Vector3Add(forward, Vector3Add(Vector3Scale(right, sx), Vector3Scale(up, sy))));
+    }
+
+    // Inverse of Direction: the (fractional) pixel a direction lands on.
+    // Returns false for directions behind the camera.
+    bool Project(Vector3 dir, float &px, float &py) const
+    {
+        Vector3 forward, right, up;
+        Basis(forward, right, up);
+        float depth = Vector3DotProduct(dir, forward);
+        if (depth <= 0.0f)
+            return false;
+
+        double scale = std::tan(0.5 * fov);
+        double aspect = static_cast<double>(width) / height;
+        double sx = Vector3DotProduct(dir, right) / depth, sy = Vector3DotProduct(dir, up) / depth;
+        px = static_cast<float>((sx / (scale * aspect) + 1.0) * 0.5 * width - 0.5);
+        py = static_cast<float>((1.0 - sy / scale) * 0.5 * height - 0.5);
+        return true;
+    }
+};
+
+enum class PixelOutcome : uint8_t
+{
+    Sky,    // Escaped; dir is the direction it leaves in
+    Disk,   // Hit the disk; point is where
+    Shadow, // Captured, or still circling after maxSteps
+};
+
+// What the ray through one pixel did. Kept per pixel so the frame can be
+// shaded again without tracing.
+struct LensSample
+{
+    PixelOutcome outcome = PixelOutcome::Shadow;
+    Vector3 dir{0, 0, 0};
+    Vector3 point{0, 0, 0};
+    int reuses = 0; // Reprojections since it was traced (RenderReprojected)
+};
+
+// HDR frame, linear RGB.
+struct Framebuffer
+{
+    int width = 0, height = 0;
+    std::vector<float> rgb;
+
+    void Resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        rgb.assign(static_cast<size_t>(w) * h * 3, 0.0f);
+    }
+
+    void Set(size_t pixel, Vector3 color)
+    {
+        rgb[3 * pixel] = color.x;
+        rgb[3 * pixel + 1] = color.y;
+        rgb[3 * pixel + 2] = color.z;
+    }
+
+    // 8-bit RGBA for display: Reinhard x / (1 + x), then gamma 2.2.
+    void ToColors(std::vector<Color> &out) const
+    {
+        out.resize(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            auto channel = [&](float v)
+            { return static_cast<unsigned char>(255.0f * std::pow(v / (1.0f + v), 1.0f / 2.2f)); };
+            out[i] = Color{channel(rgb[3 * i]), channel(rgb[3 * i + 1]), channel(rgb[3 * i + 2]), 255};
+        }
+    }
+};
+
+// The lens map packed for reuse while nothing in the scene moves. Each pixel
+// is one 32-bit texel: the escape direction of its ray, octahedrally
+// encoded with 16 bits per axis (about 3e-5 rad), or MASKED where the ray was
+// captured or hit the disk. Those pixels' colour cannot depend on the sky and
+// is kept as a short list for the disk; captured pixels are black.
+struct LensMap
+{
+    static constexpr uint32_t MASKED = 0xFFFFFFFFu;
+
+    int width = 0, height = 0;
+    std::vector<uint32_t> texels;
+    std::vector<std::pair<int, Vector3>> foreground; // Disk pixels and their colour
+
+    bool Empty() const { return texels.empty(); }
+
+    static uint32_t Encode(Vector3 dir)
+    {
+        float norm = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+        float u = dir.x / norm, v = dir.y / norm;
+        if (dir.z < 0.0f)
+        {
+            float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = fu;
+            v = fv;
+        }
+        // 65534 steps so that no direction encodes to MASKED
+        auto quantize = [](float t) { return static_cast<uint32_t>(std::lround((0.5f * t + 0.5f) * 65534.0f)); };
+        return quantize(u) << 16 | quantize(v);
+    }
+
+    static Vector3 Decode(uint32_t texel)
+    {
+        float u = (texel >> 16) / 32767.0f - 1.0f, v = (texel & 0xFFFFu) / 32767.0f - 1.0f;
+        float z = 1.0f - std::abs(u) - std::abs(v);
+        if (z < 0.0f)
+        {
+            float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = fu;
+            v = fv;
+        }
+        return Vector3Normalize(Vector3{u, v, z});
+    }
+};
+
+// Backward ray tracer for the lensed image of the hole and its disk.
+//
+// A photon stays in the plane through the hole spanned by its position and
+// direction, so each pixel's ray is traced in 2D with the Cartesian kernel:
+// x along the camera's position vector e1, y along the in-plane part e2 of the
+// pixel direction. Only the disk test and the final direction need 3D, and
+// both are a dot product with e1 and e2.
+//
+// Rays finish after very different numbers of steps -- captured pixels in a
+// few dozen, rays skimming the photon sphere in thousands -- so instead of
+// tracing one pixel to the end at a time (where lanes of a vector idle once
+// their ray has finished) the renderer is organised as a wavefront. Live
+// rays sit in one structure-of-arrays queue; each pass runs
+//
+//   integrate  one adaptive step for every live ray (a vectorized kernel)
+//   disk test  sign change of the height above the disk plane
+//   terminate  captured inside the photon sphere, escaped past escapeRadius
+//   shade      colour for every ray that finished this pass
+//
+// and finished rays are compacted out of the queue, so each pass only touches
+// rays still in flight. Bands of rows run on separate threads, each with its
+// own queue.
+struct LensingRenderer
+{
+    LensCamera camera;
+    double diskInner = 3.0;  // Disk edges (r_s); 3 r_s is the innermost stable orbit
+    double diskOuter = 12.0;
+    double accuracy = 0.04;  // Step as a fraction of the distance to the horizon
+    double minStep = 0.005;
+    double maxStep = 4.0;
+    double escapeRadius = 60.0;
+    Spacetime spacetime = Spacetime::Schwarzschild; // Metric the rays follow (metric.hpp)
+    int maxSteps = 20000;
+    unsigned threads = 0;    // 0 uses the hardware concurrency
+    int bandRows = 8;        // Rows per work item
+    int packetSize = 8;      // Trace packetSize x packetSize tiles together (1 traces single rays)
+    float packetSpread = 3.0f; // Packets split once r - 1 differs by this factor between lanes
+
+    const SkyTexture *sky = nullptr; // Background; the procedural sky if not set
+    bool filterSky = true;           // Filter the sky texture over each pixel's footprint
+    int maxAniso = 8;                // Most taps along a stretched footprint
+
+    std::vector<LensSample> map; // Per pixel, from the last Render
+    Framebuffer frame;
+    long steps = 0;              // Ray steps taken by the last Render
+
+    // Temporal reprojection (RenderReprojected)
+    LensCamera mapCamera;          // Camera the map was made for
+    std::vector<double> mapKey;    // Key() when it was made; empty if there is no map
+    float reprojectSpread = 0.02f; // Re-trace where neighbouring samples differ by more (radians)
+    int maxMargin = 6;             // Pixels the disk may move before the whole frame is traced again
+    int maxReuses = 30;            // Reprojections a sample may build on before its pixel is traced again
+    size_t retraced = 0;           // Pixels traced by the last render
+
+    // Packed map for a static scene (Refresh, ShadePacked)
+    LensMap packed;
+    LensCamera packedCamera;
+    std::vector<double> packedKey;
+
+    bool shading = true; // Whether the render in progress colours the frame
+
+    // Live rays, one array per component.
+    struct Wavefront
+    {
+        std::vector<float> x, y, vx, vy, ax, ay, k;
+        std::vector<float> px, py, z; // Position and height above the disk plane before the step
+        std::vector<float> e2x, e2y, e2z;
+        std::vector<int> pixel, count;
+
+        static constexpr std::vector<float> Wavefront::*FLOATS[] = {
+            &Wavefront::x,  &Wavefront::y,  &Wavefront::vx, &Wavefront::vy,  &Wavefront::ax,  &Wavefront::ay,
+            &Wavefront::k,  &Wavefront::px, &Wavefront::py, &Wavefront::z,   &Wavefront::e2x, &Wavefront::e2y,
+            &Wavefront::e2z};
+        static constexpr std::vector<int> Wavefront::*INTS[] = {&Wavefront::pixel, &Wavefront::count};
+
+        size_t Size() const { return pixel.size(); }
+
+        template <typename Fn>
+        void ForEach(Fn &&fn)
+        {
+            for (auto member : FLOATS)
+                fn(this->*member);
+            for (auto member : INTS)
+                fn(this->*member);
+        }
+
+        void Clear()
+        {
+            ForEach([](auto &values) { values.clear(); });
+        }
+
+        void Remove(size_t i)
+        {
+            size_t last = Size() - 1;
+            ForEach([&](auto &values)
+                    {
+                        values[i] = values[last];
+                        values.pop_back();
+                    });
+        }
+
+        // Appends entry i of another wavefront.
+        void Append(const Wavefront &from, size_t i)
+        {
+            for (auto member : FLOATS)
+                (this->*member).push_back((from.*member)[i]);
+            for (auto member : INTS)
+                (this->*member).push_back((from.*member)[i]);
+        }
+    };
+
+    // Traces the lens map and, if shade is set, shades the frame from it.
+    void Render(bool shade = true)
+    {
+        shading = shade;
+        frame.Resize(camera.width, camera.height);
+        map.assign(static_cast<size_t>(camera.width) * camera.height, LensSample{});
+        int bands = (camera.height + bandRows - 1) / bandRows;
+        std::vector<long> bandSteps(bands, 0);
+        ParallelFor(
+            bands,
+            [&](size_t band)
+            {
+                int row0 = static_cast<int>(band) * bandRows;
+                int row1 = std::min(row0 + bandRows, camera.height);
+                bandSteps[band] = WithSpacetime(spacetime, [&](auto metric)
+                                                { return TraceRows<decltype(metric)>(row0, row1); });
+            },
+            threads);
+
+        steps = 0;
+        for (long s : bandSteps)
+            steps += s;
+        retraced = map.size();
+        mapCamera = camera;
+        mapKey = Key();
+        if (shade && sky && filterSky)
+            ShadeSky(SkyDirections());
+    }
+
+    // Every setting the rays depend on apart from where the camera points.
+    std::vector<double> Key() const
+    {
+        return {camera.distance, camera.fov, static_cast<double>(camera.width), static_cast<double>(camera.height),
+                diskInner, diskOuter, accuracy, minStep, maxStep, escapeRadius, static_cast<double>(maxSteps),
+                static_cast<double>(spacetime), static_cast<double>(packetSize), packetSpread};
+    }
+
+    // Makes sure the packed map is for the current camera and settings,
+    // tracing (through reprojection when the camera only turned) and packing
+    // again if anything changed. Returns true if it did. Leaves the frame to
+    // ShadePacked, which colours every pixel from the packed map anyway.
+    bool Refresh()
+    {
+        if (!packed.Empty() && packedKey == Key() && packedCamera.azimuth == camera.azimuth &&
+            packedCamera.inclination == camera.inclination)
+            return false;
+
+        RenderReprojected(false);
+        packed.width = camera.width;
+        packed.height = camera.height;
+        packed.texels.resize(map.size());
+        packed.foreground.clear();
+        for (size_t i = 0; i < map.size(); ++i)
+        {
+            packed.texels[i] = map[i].outcome == PixelOutcome::Sky ? LensMap::Encode(map[i].dir) : LensMap::MASKED;
+            if (map[i].outcome == PixelOutcome::Disk)
+                packed.foreground.emplace_back(static_cast<int>(i), DiskColor(map[i].point));
+        }
+        packedCamera = camera;
+        packedKey = Key();
+        return true;
+    }
+
+    // Colours the frame from the packed map with the sky turned by skyAngle
+    // about the disk's axis: one sky lookup per visible sky pixel, no tracing.
+    void ShadePacked(float skyAngle = 0.0f)
+    {
+        frame.Resize(packed.width, packed.height);
+        float c = std::cos(skyAngle), s = std::sin(skyAngle);
+        std::vector<Vector3> dirs(packed.texels.size(), Vector3{0, 0, 0});
+        ParallelFor(
+            packed.texels.size(),
+            [&](size_t i)
+            {
+                uint32_t texel = packed.texels[i];
+                if (texel == LensMap::MASKED)
+                    return;
+                Vector3 d = LensMap::Decode(texel);
+                dirs[i] = Vector3{c * d.x + s * d.y, c * d.y - s * d.x, d.z}; // The sky turns by +skyAngle
+            },
+            threads, 4096);
+        ShadeSky(dirs);
+        for (const auto &[pixel, color] : packed.foreground)
+            frame.Set(pixel, color);
+    }
+
+    // Escape direction of every pixel from the map, zero where the ray did
+    // not escape.
+    std::vector<Vector3> SkyDirections() const
+    {
+        std::vector<Vector3> dirs(map.size(), Vector3{0, 0, 0});
+        for (size_t i = 0; i < map.size(); ++i)
+            if (map[i].outcome == PixelOutcome::Sky)
+                dirs[i] = map[i].dir;
+        return dirs;
+    }
+
+    // Shades the sky pixels (non-zero dirs) of the frame.
+    //
+    // With a sky texture and filterSky, each pixel is filtered over its
+    // footprint on the sky rather than point sampled. Near the Einstein ring
+    // one pixel covers a wide, stretched patch of sky and a point sample
+    // aliases into noise; the footprint comes from how the escape direction
+    // changes to the neighbouring pixels (one-sided next to the disk or the
+    // shadow), and SkyTexture::SampleFootprints picks the mip level from its
+    // narrow side and spreads taps along the long one.
+    void ShadeSky(const std::vector<Vector3> &dirs)
+    {
+        int w = frame.width, h = frame.height;
+        if (!sky || !filterSky)
+        {
+            ParallelFor(
+                dirs.size(),
+                [&](size_t i)
+                {
+                    if (dirs[i].x != 0.0f || dirs[i].y != 0.0f || dirs[i].z != 0.0f)
+                        frame.Set(i, sky ? sky->Sample(dirs[i]) : SkyColor(dirs[i]));
+                },
+                threads, 4096);
+            return;
+        }
+
+        float pixelAngle = static_cast<float>(camera.fov) / h;
+        auto escaped = [&](int x, int y)
+        {
+            const Vector3 &d = dirs[static_cast<size_t>(y) * w + x];
+            return x >= 0 && y >= 0 && x < w && y < h && (d.x != 0.0f || d.y != 0.0f || d.z != 0.0f);
+        };
+        // Change of direction per pixel along (sx, sy), or zero if no neighbour escaped
+        auto slope = [&](int x, int y, int sx, int sy)
+        {
+            bool ahead = escaped(x + sx, y + sy), behind = escaped(x - sx, y - sy);
+            Vector3 next = ahead ? dirs[static_cast<size_t>(y + sy) * w + x + sx] : dirs[static_cast<size_t>(y) * w + x];
+            Vector3 prev = behind ? dirs[static_cast<size_t>(y - sy) * w + x - sx] : dirs[static_cast<size_t>(y) * w + x];
+            return Vector3Scale(Vector3Subtract(next, prev), ahead && behind ? 0.5f : 1.0f);
+        };
+
+        ParallelFor(
+            h,
+            [&](size_t row)
+            {
+                int y = static_cast<int>(row);
+                std::vector<SkyTexture::Footprint> footprints;
+                std::vector<int> pixels;
+                for (int x = 0; x < w; ++x)
+                {
+                    if (!escaped(x, y))
+                        continue;
+                    Vector3 d = dirs[static_cast<size_t>(y) * w + x];
+                    Vector3 dx = slope(x, y, 1, 0), dy = slope(x, y, 0, 1);
+                    if (Vector3LengthSqr(dx) == 0.0f && Vector3LengthSqr(dy) == 0.0f)
+                    {
+                        // Isolated pixel: fall back to the unlensed pixel size
+                        dx = Vector3Normalize(Vector3CrossProduct(d, std::abs(d.z) < 0.9f ? Vector3{0, 0, 1}
+                                                                                          : Vector3{1, 0, 0}));
+                        dy = Vector3Scale(Vector3CrossProduct(d, dx), pixelAngle);
+                        dx = Vector3Scale(dx, pixelAngle);
+                    }
+                    footprints.push_back(sky->Project(d, dx, dy));
+                    pixels.push_back(y * w + x);
+                }
+
+                std::vector<Vector3> colors(footprints.size());
+                sky->SampleFootprints(footprints.data(), colors.data(), footprints.size(), maxAniso);
+                for (size_t i = 0; i < pixels.size(); ++i)
+                    frame.Set(pixels[i], colors[i]);
+            },
+            threads, 4);
+    }
+
+    // Renders the frame for the current camera, carrying over what it can
+    // from the last one. With shade false only the lens map is updated.
+    //
+    // The hole is spherically symmetric, so a camera that moved around it at
+    // the same distance sees, through each pixel, the ray of the matching
+    // pixel of the old view rotated by the camera's rotation R. Each new pixel
+    // is mapped back through R into the old view and its sample taken from
+    // the four nearest old pixels: escape directions and disk points are
+    // interpolated and rotated forward. Only the disk breaks the symmetry, by
+    // the angle R tilts its axis, which moves the disk's image by up to a few
+    // pixels; disk pixels are reused only when R turns about the disk's axis,
+    // and other pixels are traced again where
+    //
+    //   - they map outside the old view (newly uncovered at the edge),
+    //   - any old pixel within that margin had a different outcome (the disk
+    //     or shadow edge passes through and may have moved over it), or
+    //   - the neighbouring samples differ by more than reprojectSpread (the
+    //     lens stretches the sky there and interpolation would smear it), or
+    //   - its sample would build on more than maxReuses reprojections in a
+    //     row. Each one interpolates and rounds again, so without a limit the
+    //     error of a long camera move would keep growing. The limit varies
+    //     from pixel to pixel so the re-tracing spreads over many frames.
+    //
+    // Turning in place or orbiting at a fixed inclination reuses almost every
+    // pixel. Any other change to Key() traces everything.
+    void RenderReprojected(bool shade = true)
+    {
+        if (mapKey.empty() || mapKey != Key())
+        {
+            Render(shade);
+            return;
+        }
+        shading = shade;
+
+        // R takes the old basis to the new one
+        Vector3 f0, r0, u0, f1, r1, u1;
+        mapCamera.Basis(f0, r0, u0);
+        camera.Basis(f1, r1, u1);
+        auto back = [&](Vector3 v)
+        {
+            return Vector3Add(Vector3Scale(f0, Vector3DotProduct(v, f1)),
+                              Vector3Add(Vector3Scale(r0, Vector3DotProduct(v, r1)),
+                                         Vector3Scale(u0, Vector3DotProduct(v, u1))));
+        };
+        auto forward = [&](Vector3 v)
+        {
+            return Vector3Add(Vector3Scale(f1, Vector3DotProduct(v, f0)),
+                              Vector3Add(Vector3Scale(r1, Vector3DotProduct(v, r0)),
+                                         Vector3Scale(u1, Vector3DotProduct(v, u0))));
+        };
+
+        Vector3 axis = forward(Vector3{0, 0, 1});
+        float tilt = std::asin(std::min(1.0f, std::sqrt(axis.x * axis.x + axis.y * axis.y)));
+        if (tilt < 1e-4f)
+            tilt = 0.0f; // Rounding in the two bases
+        float pixelAngle = static_cast<float>(camera.fov) / camera.height;
+        int margin = static_cast<int>(std::ceil(tilt / pixelAngle));
+        if (margin > maxMargin)
+        {
+            Render(shade);
+            return;
+        }
+
+        std::vector<LensSample> old = std::move(map);
+        map.assign(old.size(), LensSample{});
+        frame.Resize(camera.width, camera.height);
+        float minDot = std::cos(reprojectSpread);
+
+        int bands = (camera.height + bandRows - 1) / bandRows;
+        std::vector<std::vector<int>> bandRetrace(bands);
+        ParallelFor(
+            bands,
+            [&](size_t band)
+            {
+                int row0 = static_cast<int>(band) * bandRows;
+                int row1 = std::min(row0 + bandRows, camera.height);
+                for (int row = row0; row < row1; ++row)
+                    for (int col = 0; col < camera.width; ++col)
+                    {
+                        int pixel = row * camera.width + col;
+                        if (ReprojectPixel(old, col, row, back, forward, margin, tilt, minDot))
+                        {
+                            if (shade)
+                                frame.Set(pixel, ShadeSample(map[pixel]));
+                        }
+                        else
+                        {
+                            map[pixel] = LensSample{}; // Drop whatever a rejected reprojection filled in
+                            bandRetrace[band].push_back(pixel);
+                        }
+                    }
+            },
+            threads);
+
+        std::vector<int> retrace;
+        for (auto &list : bandRetrace)
+            retrace.insert(retrace.end(), list.begin(), list.end());
+        retraced = retrace.size();
+
+        const size_t chunk = 256;
+        size_t chunks = (retrace.size() + chunk - 1) / chunk;
+        std::vector<long> chunkSteps(chunks, 0);
+        Vector3 e1 = Vector3Normalize(camera.Position());
+        ParallelFor(
+            chunks,
+            [&](size_t c)
+            {
+                Wavefront wave;
+                size_t end = std::min(retrace.size(), (c + 1) * chunk);
+                for (size_t i = c * chunk; i < end; ++i)
+                    Launch(wave, retrace[i] % camera.width, retrace[i] / camera.width, e1);
+                chunkSteps[c] = WithSpacetime(spacetime, [&](auto metric)
+                                              { return TraceWave<decltype(metric)>(wave, e1); });
+            },
+            threads);
+
+        steps = 0;
+        for (long s : chunkSteps)
+            steps += s;
+        mapCamera = camera;
+        if (shade && sky && filterSky)
+            ShadeSky(SkyDirections());
+    }
+
+    // Fills map[pixel] from the old map if the pixel can be reprojected.
+    template <typename Back, typename Forward>
+    bool ReprojectPixel(const std::vector<LensSample> &old, int col, int row, const Back &back,
+                        const Forward &forward, int margin, float tilt, float minDot)
+    {
+        float px, py;
+        if (!mapCamera.Project(back(camera.Direction(col, row)), px, py))
+            return false;
+        int x0 = static_cast<int>(std::floor(px)), y0 = static_cast<int>(std::floor(py));
+        if (x0 - margin < 0 || y0 - margin < 0 || x0 + 1 + margin >= mapCamera.width ||
+            y0 + 1 + margin >= mapCamera.height)
+            return false;
+
+        float fx = px - x0, fy = py - y0;
+        const LensSample *corner[4] = {&old[y0 * mapCamera.width + x0], &old[y0 * mapCamera.width + x0 + 1],
+                                       &old[(y0 + 1) * mapCamera.width + x0],
+                                       &old[(y0 + 1) * mapCamera.width + x0 + 1]};
+        float weight[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+
+        // Age as the interpolation weights it, so freshly traced neighbours
+        // make a sample younger instead of the oldest corner aging them all
+        float age = 0.0f;
+        for (int i = 0; i < 4; ++i)
+            age += weight[i] * corner[i]->reuses;
+        int reuses = 1 + static_cast<int>(std::lround(age));
+        if (reuses > maxReuses - (7 * col + 13 * row) % std::max(1, (maxReuses + 1) / 2))
+            return false;
+
+        PixelOutcome outcome = old[y0 * mapCamera.width + x0].outcome;
+        for (int y = y0 - margin; y <= y0 + 1 + margin; ++y)
+            for (int x = x0 - margin; x <= x0 + 1 + margin; ++x)
+                if (old[y * mapCamera.width + x].outcome != outcome)
+                    return false;
+
+        // Seen at a grazing angle, the hit point on the disk moves along the
+        // ray by many times the tilt, so a tilted disk is always traced
+        if (outcome == PixelOutcome::Disk && tilt > 0.0f)
+            return false;
+
+        LensSample &sample = map[row * camera.width + col];
+        sample.outcome = outcome;
+        sample.reuses = reuses;
+        if (outcome == PixelOutcome::Shadow)
+            return true;
+
+        Vector3 sum{0, 0, 0};
+        for (int i = 0; i < 4; ++i)
+        {
+            Vector3 v = outcome == PixelOutcome::Sky ? corner[i]->dir : corner[i]->point;
+            Vector3 first = outcome == PixelOutcome::Sky ? corner[0]->dir : corner[0]->point;
+            if (Vector3DotProduct(Vector3Normalize(v), Vector3Normalize(first)) < minDot)
+                return false;
+            sum = Vector3Add(sum, Vector3Scale(v, weight[i]));
+        }
+
+        if (outcome == PixelOutcome::Sky)
+            sample.dir = Vector3Normalize(forward(sum));
+        else
+        {
+            sample.point = forward(sum);
+            sample.point.z = 0.0f;
+        }
+        return true;
+    }
+
+    // Colours the frame again from the lens map, without tracing.
+    void Shade()
+    {
+        frame.Resize(camera.width, camera.height);
+        ParallelFor(
+            map.size(), [&](size_t i) { frame.Set(i, ShadeSample(map[i])); }, threads, 4096);
+    }
+
+    Vector3 ShadeSample(const LensSample &sample) const
+    {
+        switch (sample.outcome)
+        {
+        case PixelOutcome::Sky:
+            return sky ? sky->Sample(sample.dir) : SkyColor(sample.dir);
+        case PixelOutcome::Disk:
+            return DiskColor(sample.point);
+        default:
+            return Vector3{0, 0, 0};
+        }
+    }
+
+    // Where rays count as escaped: escapeRadius, or halfway to a cosmological
+    // horizon if that is nearer.
+    template <typename Metric>
+    double EscapeRadius() const
+    {
+        return std::min(escapeRadius, 0.5 * Metric::OUTER);
+    }
+
+    // Traces rows [row0, row1): tile by tile as packets if enabled, then
+    // whatever the packets gave up on as one wavefront. Returns the steps
+    // taken.
+    template <typename Metric>
+    long TraceRows(int row0, int row1)
+    {
+        Vector3 e1 = Vector3Normalize(camera.Position());
+        Wavefront wave;
+        long taken = 0;
+        if (packetSize > 1)
+        {
+            Wavefront packet;
+            for (int row = row0; row < row1; row += packetSize)
+                for (int col = 0; col < camera.width; col += packetSize)
+                {
+                    packet.Clear();
+                    Generate(packet, col, std::min(col + packetSize, camera.width), row,
+                             std::min(row + packetSize, row1));
+                    taken += TracePacket<Metric>(packet, wave, e1);
+                }
+        }
+        else
+            Generate(wave, 0, camera.width, row0, row1);
+        return taken + TraceWave<Metric>(wave, e1);
+    }
+
+    // Runs a wavefront until every ray has finished. Returns the steps taken.
+    template <typename Metric>
+    long TraceWave(Wavefront &wave, Vector3 e1)
+    {
+        long taken = 0;
+        while (wave.Size() > 0)
+        {
+            // Integrate
+            wave.px = wave.x;
+            wave.py = wave.y;
+            StepCartesianAdaptive<float, Metric>(wave.Size(), wave.x.data(), wave.y.data(), wave.vx.data(), wave.vy.data(),
+                                         wave.ax.data(), wave.ay.data(), wave.k.data(), static_cast<float>(accuracy),
+                                         static_cast<float>(minStep), static_cast<float>(maxStep));
+            taken += wave.Size();
+
+            Resolve<Metric>(wave, e1);
+        }
+        return taken;
+    }
+
+    // Traces the rays of one tile together. All lanes take the step the
+    // innermost one needs, and the per-lane disk and termination tests only
+    // run on passes where the packet's bounds say a lane could have crossed
+    // the disk plane, fallen in or escaped. Once the lanes have spread so far
+    // apart that the shared step would hold the outer ones back, the rest of
+    // the packet is handed to the single-ray wavefront.
+    template <typename Metric>
+    long TracePacket(Wavefront &packet, Wavefront &singles, Vector3 e1)
+    {
+        long taken = 0;
+        while (packet.Size() > 0)
+        {
+            size_t n = packet.Size();
+            float rmin2 = INFINITY, rmax2 = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                float r2 = packet.x[i] * packet.x[i] + packet.y[i] * packet.y[i];
+                rmin2 = std::min(rmin2, r2);
+                rmax2 = std::max(rmax2, r2);
+            }
+            float rmin = std::sqrt(rmin2), rmax = std::sqrt(rmax2), horizon = static_cast<float>(Metric::HORIZON);
+            if (rmax - horizon > packetSpread * (rmin - horizon))
+            {
+                for (size_t i = 0; i < n; ++i)
+                    singles.Append(packet, i);
+                packet.Clear();
+                break;
+            }
+
+            // Integrate with the shared step
+            float dt = std::clamp(static_cast<float>(accuracy) * (rmin - horizon), static_cast<float>(minStep),
+                                  static_cast<float>(maxStep));
+            packet.px = packet.x;
+            packet.py = packet.y;
+            StepCartesian<float, Metric>(n, packet.x.data(), packet.y.data(), packet.vx.data(), packet.vy.data(),
+                                 packet.ax.data(), packet.ay.data(), packet.k.data(), dt);
+            taken += n;
+
+            // Shared tests
+            bool crossed = false;
+            rmin2 = INFINITY;
+            rmax2 = 0.0f;
+            for (size_t i = 0; i < n; ++i)
+            {
+                float z = packet.x[i] * e1.z + packet.y[i] * packet.e2z[i];
+                crossed |= (z > 0.0f) != (packet.z[i] > 0.0f);
+                float r2 = packet.x[i] * packet.x[i] + packet.y[i] * packet.y[i];
+                rmin2 = std::min(rmin2, r2);
+                rmax2 = std::max(rmax2, r2);
+            }
+            float sphere = static_cast<float>(Metric::PHOTON_SPHERE), escape = static_cast<float>(EscapeRadius<Metric>());
+            bool ending = rmin2 < sphere * sphere || rmax2 > escape * escape || packet.count[0] + 1 >= maxSteps;
+            if (crossed || ending)
+            {
+                Resolve<Metric>(packet, e1);
+                continue;
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                packet.z[i] = packet.x[i] * e1.z + packet.y[i] * packet.e2z[i];
+                ++packet.count[i];
+            }
+        }
+        return taken;
+    }
+
+    // Disk test and termination for every ray after a step; finished rays
+    // are shaded (when shading) and compacted out.
+    template <typename Metric>
+    void Resolve(Wavefront &wave, Vector3 e1)
+    {
+        for (size_t i = 0; i < wave.Size();)
+        {
+            if (Finish<Metric>(wave, i, e1))
+            {
+                if (shading)
+                    frame.Set(wave.pixel[i], ShadeSample(map[wave.pixel[i]]));
+                wave.Remove(i);
+                continue;
+            }
+            wave.z[i] = wave.x[i] * e1.z + wave.y[i] * wave.e2z[i];
+            ++wave.count[i];
+            ++i;
+        }
+    }
+
+    // Queues the rays of pixels [col0, col1) x [row0, row1).
+    void Generate(Wavefront &wave, int col0, int col1, int row0, int row1) const
+    {
+        Vector3 e1 = Vector3Normalize(camera.Position());
+        for (int row = row0; row < row1; ++row)
+            for (int col = col0; col < col1; ++col)
+                Launch(wave, col, row, e1);
+    }
+
+    // Queues the ray of one pixel.
+    void Launch(Wavefront &wave, int col, int row, Vector3 e1) const
+    {
+        Vector3 d = camera.Direction(col, row);
+        float along = Vector3DotProduct(d, e1);
+        Vector3 e2 = Vector3Subtract(d, Vector3Scale(e1, along));
+        float across = Vector3Length(e2);
+        if (across < 1e-6f)
+        {
+            // Straight at the hole: any plane through e1 will do
+            e2 = std::abs(e1.z) < 0.9f ? Vector3{0, 0, 1} : Vector3{1, 0, 0};
+            e2 = Vector3Normalize(Vector3Subtract(e2, Vector3Scale(e1, Vector3DotProduct(e2, e1))));
+            across = 0.0f;
+        }
+        else
+            e2 = Vector3Scale(e2, 1.0f / across);
+
+        CartesianState s;
+        s.Init(camera.distance, 0.0, along, across);
+        wave.x.push_back(static_cast<float>(s.x));
+        wave.y.push_back(static_cast<float>(s.y));
+        wave.vx.push_back(static_cast<float>(s.vx));
+        wave.vy.push_back(static_cast<float>(s.vy));
+        wave.ax.push_back(static_cast<float>(s.ax));
+        wave.ay.push_back(static_cast<float>(s.ay));
+        wave.k.push_back(static_cast<float>(s.k));
+        wave.px.push_back(wave.x.back());
+        wave.py.push_back(wave.y.back());
+        wave.z.push_back(static_cast<float>(camera.distance) * e1.z);
+        wave.e2x.push_back(e2.x);
+        wave.e2y.push_back(e2.y);
+        wave.e2z.push_back(e2.z);
+        wave.pixel.push_back(row * camera.width + col);
+        wave.count.push_back(0);
+    }
+
+    // Disk test and termination for ray i after its step. Writes its lens
+    // sample and returns true if it is done.
+    template <typename Metric>
+    bool Finish(const Wavefront &wave, size_t i, Vector3 e1)
+    {
+        float x = wave.x[i], y = wave.y[i];
+        Vector3 e2{wave.e2x[i], wave.e2y[i], wave.e2z[i]};
+        LensSample &sample = map[wave.pixel[i]];
+
+        // Crossed the disk plane: interpolate to the crossing
+        float z = x * e1.z + y * e2.z;
+        if ((z > 0.0f) != (wave.z[i] > 0.0f))
+        {
+            float t = wave.z[i] / (wave.z[i] - z);
+            float cx = wave.px[i] + t * (x - wave.px[i]);
+            float cy = wave.py[i] + t * (y - wave.py[i]);
+            float r = std::sqrt(cx * cx + cy * cy);
+            if (r >= diskInner && r <= diskOuter)
+            {
+                sample.outcome = PixelOutcome::Disk;
+                sample.point = Vector3Add(Vector3Scale(e1, cx), Vector3Scale(e2, cy));
+                return true;
+            }
+        }
+
+        float r = std::sqrt(x * x + y * y);
+        bool outbound = x * wave.vx[i] + y * wave.vy[i] > 0.0f;
+        if ((r < static_cast<float>(Metric::PHOTON_SPHERE) && !outbound) || r < static_cast<float>(Metric::HORIZON) ||
+            wave.count[i] >= maxSteps)
+        {
+            sample.outcome = PixelOutcome::Shadow; // Inside the photon sphere and falling
+            return true;
+        }
+        if (r > EscapeRadius<Metric>() && outbound)
+        {
+            float v = std::sqrt(wave.vx[i] * wave.vx[i] + wave.vy[i] * wave.vy[i]);
+            sample.outcome = PixelOutcome::Sky;
+            sample.dir = Vector3Scale(Vector3Add(Vector3Scale(e1, wave.vx[i]), Vector3Scale(e2, wave.vy[i])), 1.0f / v);
+            return true;
+        }
+        return false;
+    }
+
+    // Procedural background: a faint latitude-longitude grid and hashed stars.
+    static Vector3 SkyColor(Vector3 dir)
+    {
+        double lon = std::atan2(dir.y, dir.x);
+        double lat = std::asin(std::clamp(static_cast<double>(dir.z), -1.0, 1.0));
+
+        Vector3 color{0.01f, 0.01f, 0.02f};
+        const double cell = 10.0 * DEG2RAD;
+        double fl = std::abs(std::remainder(lon, cell)) / cell, ft = std::abs(std::remainder(lat, cell)) / cell;
+        if (fl < 0.02 || ft < 0.02)
+            color = Vector3{0.08f, 0.08f, 0.12f};
+
+        const double starCell = 0.5 * DEG2RAD;
+        uint32_t h = static_cast<uint32_t>(std::floor(lon / starCell)) * 73856093u ^
+                     static_cast<uint32_t>(std::floor(lat / starCell)) * 19349663u;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        if ((h & 1023u) < 12u)
+        {
+            float brightness = 0.5f + (h >> 10 & 255u) / 64.0f;
+            color = Vector3Add(color, Vector3{brightness, brightness, brightness * 1.1f});
+        }
+        return color;
+    }
+
+    // Thin-disk emission: Novikov-Thorne-like profile r^-3 (1 - sqrt(r_in/r)),
+    // hot and white at the inner edge, cooling to orange.
+    Vector3 DiskColor(Vector3 point) const
+    {
+        double r = std::sqrt(point.x * point.x + point.y * point.y);
+        double flux = std::pow(diskInner / r, 3.0) * (1.0 - std::sqrt(diskInner / r));
+        float intensity = static_cast<float>(40.0 * flux);
+        float t = static_cast<float>(std::clamp((r - diskInner) / (diskOuter - diskInner), 0.0, 1.0));
+        return Vector3{intensity, intensity * (0.85f - 0.45f * t), intensity * (0.7f - 0.6f * t)};
+    }
+};
+
+// Headless run of the paths the lensing view takes (--smoke-lensing). In each
+// spacetime it renders a frame, turns the camera a little and renders it again
+// by reprojection, then packs the map with Refresh and shades it. Returns
+// false if a frame has a non-finite pixel, reprojection traced everything
+// again, its frame strays from a full render by more than `tolerance`
+// (relative mean difference), or an unchanged camera makes Refresh trace.
+struct LensingSmoke
+{
+    int width = 160, height = 90;
+    double turn = 0.01;      // Radians of azimuth between the renders
+    float tolerance = 0.05f;
+
+    bool Run(std::ostream &out) const
+    {
+        bool ok = true;
+        for (int i = 0; i < SPACETIMES; ++i)
+        {
+            LensingRenderer lens;
+            lens.camera.width = width;
+            lens.camera.height = height;
+            lens.spacetime = static_cast<Spacetime>(i);
+
+            lens.Render();
+            long steps = lens.steps;
+            bool rendered = Finite(lens.frame) && steps > 0;
+
+            lens.camera.azimuth += turn;
+            lens.RenderReprojected();
+            size_t retraced = lens.retraced;
+            LensingRenderer full = lens;
+            full.Render();
+            float difference = Difference(lens.frame, full.frame);
+            bool reprojected = Finite(lens.frame) && retraced < lens.map.size() && difference < tolerance;
+
+            bool packed = lens.Refresh() && !lens.Refresh();
+            lens.ShadePacked(0.1f);
+            packed = packed && Finite(lens.frame);
+
+            const char *name = WithSpacetime(lens.spacetime, [](auto metric) { return decltype(metric)::NAME; });
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-24s steps %9ld, reprojection retraced %5.1f%% (difference %.4f): %s\n",
+                          name, steps, 100.0 * retraced / lens.map.size(), difference,
+                          rendered && reprojected && packed ? "ok" : "FAILED");
+            out << line;
+            ok = ok && rendered && reprojected && packed;
+        }
+        return ok;
+    }
+
+    static bool Finite(const Framebuffer &frame)
+    {
+        return !frame.rgb.empty() && std::all_of(frame.rgb.begin(), frame.rgb.end(), [](float v) { return std::isfinite(v); });
+    }
+
+    // Mean |a - b| over the mean |b|.
+    static float Difference(const Framebuffer &a, const Framebuffer &b)
+    {
+        double diff = 0.0, total = 0.0;
+        for (size_t i = 0; i < b.rgb.size(); ++i)
+        {
+            diff += std::abs(a.rgb[i] - b.rgb[i]);
+            total += std::abs(b.rgb[i]);
+        }
+        return total > 0.0 ? static_cast<float>(diff / total) : 0.0f;
+    }
+};
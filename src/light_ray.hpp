@@ -0,0 +1,341 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "cartesian_kernel.hpp"
+#include "dense_output.hpp"
+#include "effective_potential.hpp"
+#include "far_field.hpp"
+#include "geodesic_atlas.hpp"
+#include "physics.hpp"
+#include "strong_deflection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Equations a ray is integrated with
+enum class RayKernel
+{
+    Polar,     // Polar geodesic equations with the speed held at c
+    Cartesian, // Trig-free central acceleration (cartesian_kernel.hpp)
+};
+
+struct LightRay
+{
+    Vector2 pos; // cartesian
+    Vector2 dir;
+    Vector2 velocity; // m/s, kept for the dense output
+
+    double r, phi; // polar
+    double dr = 0.0, dphi = 0.0;
+
+    std::vector<Vector2> path;
+    bool recordPath = true; // Headless users (e.g. solvers) can skip the trail
+    TrailSampler trail;     // Where trail points go along the trajectory
+    size_t maxTrail = 0;    // Most recent trail points kept (0 keeps all)
+
+    double time = 0.0;    // Integration time so far (seconds)
+    StepInterpolant step; // Dense output of the last step
+
+    RayOutcome outcome = RayOutcome::Active;
+
+    FarFieldLeg farField; // Analytic leg while outside the far-field radius
+
+    const GeodesicAtlas *atlas = nullptr;
+    AtlasTrack atlasTrack; // Position on the atlas while the ray follows it
+
+    bool windingLegs = false; // Fast-forward windings around the photon sphere
+    WindingLeg winding;
+
+    // The far-field legs, the atlas, the winding legs and the effective
+    // potential all model the polar kernel, so Cartesian rays skip them. The
+    // polar equations are Schwarzschild's; other spacetimes need the
+    // Cartesian kernel, which follows cartesian.spacetime.
+    RayKernel kernel = RayKernel::Polar;
+    CartesianState cartesian; // State of the Cartesian kernel, in r_s and c
+
+    LightRay(Vector2 position = {0, 0}, Vector2 direction = {1, 0})
+        : pos(position), dir(direction),
+          velocity{static_cast<float>(direction.x * c), static_cast<float>(direction.y * c)}
+    {
+        r = hypot(pos.x, pos.y) / VIS_SCALE;
+        phi = atan2(pos.y, pos.x); // Calculate initial angle
+
+        path.push_back(pos); // Initialize path with the starting position
+    }
+
+    // farFieldRadius (meters) enables the analytic weak-field zone; rays
+    // outside it skip the geodesic equations entirely. 0 disables it.
+    void Update(double dt, double r_s, double farFieldRadius = 0.0)
+    {
+        if (Advance(dt, r_s, farFieldRadius))
+            RecordStep();
+    }
+
+    // Adds the trail points that fall inside the last step. A capped trail
+    // is trimmed once it overshoots by a quarter, so the cost of dropping old
+    // points is spread over many steps.
+    void RecordStep()
+    {
+        if (!recordPath)
+            return;
+        trail.Record(step, path);
+        if (maxTrail > 0 && path.size() > maxTrail + maxTrail / 4)
+            path.erase(path.begin(), path.end() - maxTrail);
+    }
+
+    // Records an outcome that is already certain. Captured rays stop here.
+    // Escaping rays keep being integrated while the bending is strong, then,
+    // if the far-field zone is enabled, coast on an analytic leg once beyond
+    // coastRadius (meters), at the cost of one sqrt per update instead of the
+    // geodesic equations.
+    void Finalize(RayOutcome result, double radius = 0.0)
+    {
+        outcome = result;
+        coastRadius = radius;
+    }
+
+    double coastRadius = 0.0;
+
+    // Makes the ray follow precomputed atlas curves instead of integrating.
+    // Returns false, leaving the ray to the integrator, if the atlas cannot
+    // represent it.
+    bool PlaceOnAtlas(const GeodesicAtlas &source, double r_s)
+    {
+        atlas = &source;
+        double scale = 1.0 / (VIS_SCALE * r_s);
+        return atlas->Place(pos.x * scale, pos.y * scale, dir.x, dir.y, atlasTrack);
+    }
+
+    // Position at any time inside the last step.
+    Vector2 SampleAt(double t) const { return step.Sample(t); }
+
+    // Integrates one step without touching the trail, so schedulers can take
+    // several sub-steps per frame. Returns false if the ray did not move.
+    bool Advance(double dt, double r_s, double farFieldRadius = 0.0)
+    {
+        // Start of the step for the dense output
+        step.t0 = time;
+        step.x0 = pos.x;
+        step.y0 = pos.y;
+        step.vx0 = velocity.x * VIS_SCALE;
+        step.vy0 = velocity.y * VIS_SCALE;
+
+        if (!Integrate(dt, r_s, farFieldRadius))
+            return false;
+
+        time += dt;
+        step.t1 = time;
+        step.x1 = pos.x;
+        step.y1 = pos.y;
+        step.vx1 = velocity.x * VIS_SCALE;
+        step.vy1 = velocity.y * VIS_SCALE;
+        return true;
+    }
+
+    // One step along the far-field leg and/or the polar geodesic equations,
+    // or of the Cartesian kernel.
+    bool Integrate(double dt, double r_s, double farFieldRadius)
+    {
+        if (kernel == RayKernel::Cartesian)
+            return IntegrateCartesian(dt, r_s);
+
+        // Coasting is a far-field leg, so it is off along with the far field
+        if (outcome == RayOutcome::Escaped && farFieldRadius > 0.0)
+            farFieldRadius = std::max(farFieldRadius, coastRadius);
+
+        if (atlasTrack.active)
+            return AdvanceAtlas(dt, r_s);
+
+        if (windingLegs && !winding.active)
+        {
+            double scale = 1.0 / (VIS_SCALE * r_s);
+            winding.Enter(pos.x * scale, pos.y * scale, dir.x, dir.y);
+        }
+
+        if (winding.active)
+        {
+            dt = AdvanceWinding(dt, r_s);
+            if (dt <= 0.0)
+                return true;
+        }
+
+        if (farFieldRadius > 0.0 && !farField.active)
+            farField = FarFieldLeg::Solve(pos.x / VIS_SCALE, pos.y / VIS_SCALE, dir.x, dir.y, r_s, farFieldRadius);
+
+        if (farField.active)
+        {
+            dt = AdvanceFarField(dt);
+            if (dt <= 0.0)
+                return true;
+        }
+
+        r = hypot(pos.x, pos.y) / VIS_SCALE;
+        phi = atan2(pos.y, pos.x);
+
+        // Safety check
+        if (r <= 0)
+            return false;
+
+        if (r < r_s)
+        {
+            // Light ray is within the Schwarzschild radius, it is absorbed
+            outcome = RayOutcome::Captured;
+            return false;
+        }
+
+        // Convert Cartesian velocity to polar coordinates
+        // pos = (r*cos(phi), r*sin(phi)) in scaled coordinates
+        Vector2 r_hat = {static_cast<float>(cos(phi)), static_cast<float>(sin(phi))};
+        Vector2 phi_hat = {static_cast<float>(-sin(phi)), static_cast<float>(cos(phi))};
+
+        // Current velocities in polar coordinates
+        double v_r = (dir.x * r_hat.x + dir.y * r_hat.y) * c;       // Radial velocity
+        double v_phi = (dir.x * phi_hat.x + dir.y * phi_hat.y) * c; // Tangential velocity
+
+        // Convert tangential velocity to angular velocity: v_phi = r * dphi/dt
+        double dphi_dt = v_phi / r;
+        double dr_dt = v_r;
+
+        // Geodesic equations for light rays in Schwarzschild metric
+        // These are the exact equations of motion for photons
+
+        // For light rays, we use the affine parameter λ instead of coordinate time t
+        // But for numerical integration, we can use coordinate time with proper scaling
+
+        // The key conserved quantities for light rays:
+        // 1. Energy: E (related to dt/dλ)
+        // 2. Angular momentum: L = r² * dφ/dλ
+
+        // Since we're already in motion, we can calculate L from current state
+        double L = r * r * dphi_dt / c; // Angular momentum per unit energy
+
+        // Geodesic equations in Schwarzschild coordinates for light (ds² = 0):
+        // d²r/dλ² = -GM/r² + L²/r³ - 3GM*L²/r⁴
+        // d²φ/dλ² = -2/r * dr/dλ * dφ/dλ
+
+        // Converting to coordinate time derivatives using r_s = 2GM/c²:
+        // d²r/dt² = -(r_s*c²)/(2*r²) + L²*c²/r³ - (3*r_s*L²*c²)/(2*r⁴)
+        // d²φ/dt² = -2/r * dr/dt * dφ/dt
+
+        double r2 = r * r;
+        double r3 = r2 * r;
+        double r4 = r3 * r;
+        double c2 = c * c;
+
+        // Second derivatives (accelerations)
+        double d2r_dt2 = -(r_s * c2) / (2.0 * r2) + (L * L * c2) / r3 - (3.0 * r_s * L * L * c2) / (2.0 * r4);
+        double d2phi_dt2 = (-2.0 / r) * dr_dt * dphi_dt;
+
+        // Update velocities first
+        dr_dt += d2r_dt2 * dt;
+        dphi_dt += d2phi_dt2 * dt;
+
+        // Update position
+        r += dr_dt * dt;
+        phi += dphi_dt * dt;
+
+        // Convert back to Cartesian coordinates
+        pos.x = static_cast<float>(r * cos(phi) * VIS_SCALE);
+        pos.y = static_cast<float>(r * sin(phi) * VIS_SCALE);
+
+        // Update direction vector from new velocities
+        Vector2 new_r_hat = {static_cast<float>(cos(phi)), static_cast<float>(sin(phi))};
+        Vector2 new_phi_hat = {static_cast<float>(-sin(phi)), static_cast<float>(cos(phi))};
+
+        // Convert polar velocities back to Cartesian direction
+        Vector2 velocity_cart = {
+            static_cast<float>(dr_dt * new_r_hat.x + r * dphi_dt * new_phi_hat.x),
+            static_cast<float>(dr_dt * new_r_hat.y + r * dphi_dt * new_phi_hat.y)};
+
+        dir = Vector2Normalize(velocity_cart);
+        velocity = velocity_cart;
+        return true;
+    }
+
+    // One step of the Cartesian kernel.
+    bool IntegrateCartesian(double dt, double r_s)
+    {
+        if (!cartesian.ready)
+        {
+            double scale = 1.0 / (VIS_SCALE * r_s);
+            cartesian.Init(pos.x * scale, pos.y * scale, dir.x, dir.y);
+        }
+
+        if (cartesian.Radius() < cartesian.Horizon())
+        {
+            outcome = RayOutcome::Captured;
+            return false;
+        }
+
+        cartesian.Step(c * dt / r_s);
+        SyncCartesian(r_s);
+        return true;
+    }
+
+    // Updates the presentation state from the Cartesian kernel's.
+    void SyncCartesian(double r_s)
+    {
+        double scale = r_s * VIS_SCALE;
+        pos = {static_cast<float>(cartesian.x * scale), static_cast<float>(cartesian.y * scale)};
+        velocity = {static_cast<float>(cartesian.vx * c), static_cast<float>(cartesian.vy * c)};
+        dir = Vector2Normalize(velocity);
+    }
+
+    // Moves the ray along its atlas curves. When they run out the ray is either
+    // captured or has left the atlas and coasts on from there.
+    bool AdvanceAtlas(double dt, double r_s)
+    {
+        atlasTrack.s += c * dt / r_s;
+
+        double x, y, dirX, dirY;
+        if (!atlas->Evaluate(atlasTrack, x, y, dirX, dirY))
+        {
+            atlasTrack.active = false;
+            if (GeodesicAtlas::Captured(atlasTrack))
+                outcome = RayOutcome::Captured;
+            else
+                Finalize(RayOutcome::Escaped, 0.99 * atlas->outerRadius * r_s);
+            return false;
+        }
+
+        double scale = r_s * VIS_SCALE;
+        pos = {static_cast<float>(x * scale), static_cast<float>(y * scale)};
+        dir = {static_cast<float>(dirX), static_cast<float>(dirY)};
+        velocity = {static_cast<float>(dirX * c), static_cast<float>(dirY * c)};
+        return true;
+    }
+
+    // Moves the ray around the photon sphere in closed form. Returns the part
+    // of dt left over once it leaves the shell.
+    double AdvanceWinding(double dt, double r_s)
+    {
+        double remaining = winding.Advance(c * dt / r_s) * r_s / c;
+
+        double x, y, dirX, dirY;
+        winding.Evaluate(x, y, dirX, dirY);
+        double scale = r_s * VIS_SCALE;
+        pos = {static_cast<float>(x * scale), static_cast<float>(y * scale)};
+        dir = {static_cast<float>(dirX), static_cast<float>(dirY)};
+        velocity = {static_cast<float>(dirX * c), static_cast<float>(dirY * c)};
+
+        return remaining;
+    }
+
+    // Moves the ray along its far-field leg. Returns the part of dt left over
+    // once the ray has crossed into the inner zone.
+    double AdvanceFarField(double dt)
+    {
+        double remaining = farField.Advance(c * dt) / c;
+
+        double x, y, dirX, dirY;
+        farField.Evaluate(x, y, dirX, dirY);
+        pos = {static_cast<float>(x * VIS_SCALE), static_cast<float>(y * VIS_SCALE)};
+        dir = {static_cast<float>(dirX), static_cast<float>(dirY)};
+        velocity = {static_cast<float>(dirX * c), static_cast<float>(dirY * c)};
+
+        return remaining;
+    }
+};
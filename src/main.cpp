@@ -1,160 +1,429 @@
 #include "raylib.h"
 #include "raymath.h"
 
+#include "autotune.hpp"
+#include "block_steps.hpp"
+#include "critical_impact.hpp"
+#include "generic_metric.hpp"
+#include "lensing_renderer.hpp"
+#include "light_ray.hpp"
+#include "physics.hpp"
+#include "post_process.hpp"
+#include "quality_governor.hpp"
+#include "ray_profile.hpp"
+#include "ray_store.hpp"
+#include "star_lensing.hpp"
+
+#include <algorithm>
 #include <iostream>
+#include <string>
 #include <vector>
 
-const double c = 299792458.0f; // Speed of light in m/s
-const double G = 6.67430e-11f; // Gravitational constant in m^3 kg^-1 s^-2
-const double VIS_SCALE = 6e-9; // Visualization scale: meters to pixels
-
 const double TIME_MULTIPLIER = 100;
-
-struct BlackHole
+const int TARGET_FPS = 60;
+const double BLACK_HOLE_MASS = 8.54e36; // kg
+
+// Settings that can be changed while the simulation runs. Pressing the key
+// flips one (or steps through its values) and launches the rays again when
+// they depend on it; the flag does the same before the first launch and may
+// be repeated.
+struct Switch
 {
-    Vector2 pos;
-    double mass;
-
-    double r_s; // Schwarzschild radius
+    int key;
+    const char *flag;
+    const char *name;
+};
 
-    BlackHole(Vector2 position, double m)
-        : pos(position), mass(m)
-    {
-        r_s = (2 * G * mass) / (c * c); // Calculate Schwarzschild radius
-    }
+const Switch SWITCHES[] = {
+    {KEY_K, "--cartesian", "kernel"},
+    {KEY_M, "--spacetime", "spacetime"},
+    {KEY_C, "--critical", "critical launch"},
+    {KEY_B, "--block-steps", "block steps"},
+    {KEY_F, "--far-field", "far field"},
+    {KEY_W, "--winding-legs", "winding legs"},
+    {KEY_A, "--atlas", "atlas"},
+    {KEY_D, "--differentials", "ray differentials"},
+    {KEY_N, "--fan", "ray fan"},
+    {KEY_G, "--govern", "quality governor"},
+    {KEY_T, "--tuned", "autotuned store"},
+    {KEY_L, "--lensing", "lensing view"},
+    {KEY_S, "--stars", "star catalog"},
+    {KEY_R, "--sky-rotation", "sky rotation"},
 };
 
-struct LightRay
+struct Simulation
 {
-    Vector2 pos; // cartesian
-    Vector2 dir;
-
-    double r, phi; // polar
-    double dr = 0.0, dphi = 0.0;
-
-    std::vector<Vector2> path;
-
-    LightRay(Vector2 position = {0, 0}, Vector2 direction = {1, 0})
-        : pos(position), dir(direction)
-    {
-        r = hypot(pos.x, pos.y) / VIS_SCALE;
-        phi = atan2(pos.y, pos.x); // Calculate initial angle
-
-        path.push_back(pos); // Initialize path with the starting position
-    }
+    BlackHole blackHole;
+    std::vector<LightRay> lightRays;
+    Vector2 center;
 
-    void Update(double dt, double r_s)
+    // Rays beyond this radius (in Schwarzschild radii) move along analytic
+    // weak-field legs instead of being integrated, which makes rays spawned
+    // far from the hole much cheaper. The expansion is first order in r_s/b,
+    // so the final direction is off by about a degree for rays that pass at
+    // 20 r_s. It is off by default: the hand-tuned demo ray below sits so close
+    // to the critical impact parameter that any such error changes its orbit.
+    // F switches it to 8 r_s and the launch to criticalLaunch.
+    double farFieldRadius = 0.0;
+
+    // Rays near the hole take up to 2^maxLevel sub-steps per frame. Off (one
+    // step per frame) by default for the same reason: sub-stepping moves the
+    // critical offset below the demo ray's, which then leaves to the lower
+    // right instead of orbiting. criticalLaunch re-derives the offset; B
+    // switches to 16 sub-steps and turns it on.
+    BlockScheduler scheduler;
+    double trailSpacing = 3.0; // Pixels between trail points, independent of the step size
+
+    // Near-critical rays skip their windings around the photon sphere
+    // analytically. The demo ray takes such a leg for about 180 frames, and
+    // the leg's small error turns its exit by some 7 degrees, so it is off by
+    // default too. W switches the legs on together with criticalLaunch.
+    bool windingLegs = false;
+
+    // Launches the demo ray criticalMargin pixels outside the capture boundary
+    // CriticalImpactSolver finds for the settings above, instead of at the
+    // hand-tuned offset, so it keeps making a single orbit when the mass, the
+    // frame step or the scheduler change.
+    bool criticalLaunch = false;
+    float criticalMargin = 0.016f;
+
+    // Precomputed photon paths. With many rays on screen, following the atlas
+    // replaces integration by a lookup per ray and frame; rays it cannot
+    // represent keep being integrated. A switches it; the atlas is built the
+    // first time.
+    bool useAtlas = false;
+    GeodesicAtlas atlas;
+
+    // Cartesian rays follow the exact photon orbits (photon sphere at 1.5 r_s)
+    // and are stepped in batches by the store; the polar kernel is what the
+    // demo ray and the analytic shortcuts above are tuned for.
+    RayKernel kernel = RayKernel::Polar;
+    RayStore store;
+    bool rayDifferentials = false; // Cartesian rays carry d(state)/d(launch offset) for magnification
+    bool autotune = false; // Load the store's tuning from the cache file, measuring it on first run
+
+    // Metric the Cartesian rays and the lensing view follow (metric.hpp). The
+    // polar equations are Schwarzschild's, so any other spacetime runs the
+    // rays on the Cartesian kernel.
+    Spacetime spacetime = Spacetime::Schwarzschild;
+
+    // Rays launched from the left edge besides the demo ray, spread evenly
+    // over the screen height, to give the kernels a population to work on. N
+    // switches between none and 200.
+    int fanRays = 0;
+
+    // Attributes integration time to individual rays and prints the most
+    // expensive ones on exit.
+    bool profileRays = false;
+    RayProfile profile;
+
+    // Scales trail length, trail spacing and the step accuracy of the rays and
+    // of the lensing view to hold the frame rate (G). Trails keep at most
+    // maxTrail points (0 for unlimited), which is also the longest trail the
+    // governor allows; an unlimited trail gives it governedTrail to work with.
+    // While governing, Run paces the frames itself so the work it measures
+    // includes the present.
+    bool governQuality = false;
+    size_t maxTrail = 0;
+    size_t governedTrail = 4000;
+    QualityGovernor governor;
+
+    // Shows the hole and its disk as seen by a camera, traced backwards from
+    // every pixel, instead of the ray view. L switches views; the sky, the
+    // texture and the catalog are loaded the first time they are needed.
+    bool lensingView = false;
+    LensingRenderer lensing;
+    Texture2D lensTexture{};
+    std::string skyPath = "sky.bhsky"; // From --convert-sky; the procedural sky if missing
+    SkyTexture sky;
+    bool starCatalog = false; // Point stars lensed forward over the backward-traced image
+    StarLensing stars;
+    double skyRotation = 0.0; // Radians per second (R); the lens map is reused, so turning costs one lookup per pixel
+    double skyAngle = 0.0;
+    bool postProcess = true; // Bloom and filmic tone mapping instead of plain Reinhard
+    PostProcess post;
+
+    Simulation(int width, int height, const std::vector<std::string> &flags = {})
+        : blackHole(Vector2{0, 0}, BLACK_HOLE_MASS), center{width / 2.0f, height / 2.0f}
     {
-        r = hypot(pos.x, pos.y) / VIS_SCALE;
-        phi = atan2(pos.y, pos.x);
+        lensing.camera.width = width / 2;
+        lensing.camera.height = height / 2;
 
-        // Safety check
-        if (r <= 0)
-            return;
-
-        if (r < r_s)
+        for (const std::string &flag : flags)
         {
-            // Light ray is within the Schwarzschild radius, it is absorbed
-            return;
+            auto it = std::find_if(std::begin(SWITCHES), std::end(SWITCHES),
+                                   [&](const Switch &s) { return flag == s.flag; });
+            if (it == std::end(SWITCHES))
+                std::cerr << "Unknown option " << flag << std::endl;
+            else
+                Flip(it->key, false);
         }
 
-        // Convert Cartesian velocity to polar coordinates
-        // pos = (r*cos(phi), r*sin(phi)) in scaled coordinates
-        Vector2 r_hat = {static_cast<float>(cos(phi)), static_cast<float>(sin(phi))};
-        Vector2 phi_hat = {static_cast<float>(-sin(phi)), static_cast<float>(cos(phi))};
-
-        // Current velocities in polar coordinates
-        double v_r = (dir.x * r_hat.x + dir.y * r_hat.y) * c;       // Radial velocity
-        double v_phi = (dir.x * phi_hat.x + dir.y * phi_hat.y) * c; // Tangential velocity
-
-        // Convert tangential velocity to angular velocity: v_phi = r * dphi/dt
-        double dphi_dt = v_phi / r;
-        double dr_dt = v_r;
-
-        // Geodesic equations for light rays in Schwarzschild metric
-        // These are the exact equations of motion for photons
-
-        // For light rays, we use the affine parameter λ instead of coordinate time t
-        // But for numerical integration, we can use coordinate time with proper scaling
-
-        // The key conserved quantities for light rays:
-        // 1. Energy: E (related to dt/dλ)
-        // 2. Angular momentum: L = r² * dφ/dλ
-
-        // Since we're already in motion, we can calculate L from current state
-        double L = r * r * dphi_dt / c; // Angular momentum per unit energy
+        governor.full = QualitySettings{maxTrail > 0 ? maxTrail : governedTrail, trailSpacing, scheduler.accuracy,
+                                        lensing.accuracy};
+        governor.targetFps = TARGET_FPS;
 
-        // Geodesic equations in Schwarzschild coordinates for light (ds² = 0):
-        // d²r/dλ² = -GM/r² + L²/r³ - 3GM*L²/r⁴
-        // d²φ/dλ² = -2/r * dr/dλ * dφ/dλ
+        if (lensingView)
+            ShowLensing();
 
-        // Converting to coordinate time derivatives using r_s = 2GM/c²:
-        // d²r/dt² = -(r_s*c²)/(2*r²) + L²*c²/r³ - (3*r_s*L²*c²)/(2*r⁴)
-        // d²φ/dt² = -2/r * dr/dt * dφ/dt
-
-        double r2 = r * r;
-        double r3 = r2 * r;
-        double r4 = r3 * r;
-        double c2 = c * c;
+        if (profileRays)
+        {
+            scheduler.profile = &profile;
+            store.profile = &profile;
+        }
 
-        // Second derivatives (accelerations)
-        double d2r_dt2 = -(r_s * c2) / (2.0 * r2) + (L * L * c2) / r3 - (3.0 * r_s * L * L * c2) / (2.0 * r4);
-        double d2phi_dt2 = (-2.0 / r) * dr_dt * dphi_dt;
+        Launch();
+    }
 
-        // Update velocities first
-        dr_dt += d2r_dt2 * dt;
-        dphi_dt += d2phi_dt2 * dt;
+    // The kernel the rays run on.
+    RayKernel Kernel() const { return spacetime == Spacetime::Schwarzschild ? kernel : RayKernel::Cartesian; }
 
-        // Update position
-        r += dr_dt * dt;
-        phi += dphi_dt * dt;
+    // Launches the rays afresh from the current settings, dropping any there
+    // were.
+    void Launch()
+    {
+        lightRays.clear();
+        scheduler.levels.clear();
+        store.Clear();
+        profile.costs.clear();
+
+        // Makes a single orbit around the black hole. The offset sits just above
+        // the critical one for one step per frame at 60 frames per second
+        // (285.974 px, as CriticalImpactSolver finds it).
+        float offset = 285.99f;
+        if (criticalLaunch)
+        {
+            CriticalImpact critical = WithSpacetime(spacetime,
+                                                    [&](auto metric)
+                                                    {
+                                                        CriticalImpactSolver<decltype(metric)> solver;
+                                                        solver.scheduler = scheduler;
+                                                        solver.windingLegs = windingLegs;
+                                                        solver.kernel = Kernel();
+                                                        solver.store = store;
+                                                        return solver.Find(blackHole.r_s, TIME_MULTIPLIER / TARGET_FPS,
+                                                                           center.x, farFieldRadius * blackHole.r_s);
+                                                    });
+            if (critical.Valid())
+                offset = static_cast<float>(critical.b) + criticalMargin;
+        }
+        lightRays.emplace_back(Vector2{-center.x, offset}, Vector2{1, 0});
 
-        // Convert back to Cartesian coordinates
-        pos.x = static_cast<float>(r * cos(phi) * VIS_SCALE);
-        pos.y = static_cast<float>(r * sin(phi) * VIS_SCALE);
+        // Start rays from the left edge, relative to center
+        for (int i = 1; i <= fanRays; ++i)
+        {
+            float y = 2.0f * center.y * i / (fanRays + 1) - center.y;
+            lightRays.emplace_back(Vector2{-center.x, y}, Vector2{1, 0});
+        }
 
-        // Update direction vector from new velocities
-        Vector2 new_r_hat = {static_cast<float>(cos(phi)), static_cast<float>(sin(phi))};
-        Vector2 new_phi_hat = {static_cast<float>(-sin(phi)), static_cast<float>(cos(phi))};
+        for (auto &lr : lightRays)
+        {
+            lr.trail = TrailSampler{TrailMode::ArcLength, trailSpacing};
+            lr.windingLegs = windingLegs;
+            lr.maxTrail = maxTrail;
+        }
+        if (governQuality)
+            ApplyQuality(governor.Current());
 
-        // Convert polar velocities back to Cartesian direction
-        Vector2 velocity_cart = {
-            static_cast<float>(dr_dt * new_r_hat.x + r * dphi_dt * new_phi_hat.x),
-            static_cast<float>(dr_dt * new_r_hat.y + r * dphi_dt * new_phi_hat.y)};
+        store.spacetime = spacetime;
+        if (Kernel() == RayKernel::Cartesian)
+        {
+            store.differentials = rayDifferentials;
+            for (size_t i = 0; i < lightRays.size(); ++i)
+                store.Add(lightRays[i], static_cast<int>(i), blackHole.r_s);
+        }
+        else if (useAtlas)
+        {
+            if (!atlas.Built())
+                atlas.Build();
+            for (auto &lr : lightRays)
+                lr.PlaceOnAtlas(atlas, blackHole.r_s);
+        }
+    }
 
-        dir = Vector2Normalize(velocity_cart);
+    // Flips the setting bound to `key` in SWITCHES, launching the rays again
+    // or redrawing the lensing view if they depend on it; the constructor
+    // passes apply = false to only record the setting. Returns false for a
+    // key bound to nothing.
+    bool Flip(int key, bool apply = true)
+    {
+        switch (key)
+        {
+        case KEY_K:
+            kernel = kernel == RayKernel::Polar ? RayKernel::Cartesian : RayKernel::Polar;
+            break;
+        case KEY_M:
+            spacetime = static_cast<Spacetime>((static_cast<int>(spacetime) + 1) % SPACETIMES);
+            lensing.spacetime = spacetime;
+            if (apply && lensingView)
+                RenderLensing();
+            break;
+        case KEY_C:
+            criticalLaunch = !criticalLaunch;
+            break;
+        case KEY_B:
+            // These move the capture boundary past the hand-tuned offset
+            scheduler.maxLevel = scheduler.maxLevel > 0 ? 0 : 4;
+            criticalLaunch |= scheduler.maxLevel > 0;
+            break;
+        case KEY_F:
+            farFieldRadius = farFieldRadius > 0.0 ? 0.0 : 8.0;
+            criticalLaunch |= farFieldRadius > 0.0;
+            break;
+        case KEY_W:
+            windingLegs = !windingLegs;
+            criticalLaunch |= windingLegs;
+            break;
+        case KEY_A:
+            useAtlas = !useAtlas;
+            break;
+        case KEY_D:
+            rayDifferentials = !rayDifferentials;
+            break;
+        case KEY_N:
+            fanRays = fanRays > 0 ? 0 : 200;
+            break;
+        case KEY_L:
+            lensingView = !lensingView;
+            if (apply && lensingView)
+                ShowLensing();
+            return true;
+        case KEY_S:
+            starCatalog = !starCatalog;
+            if (apply && lensingView)
+                ShowLensing();
+            return true;
+        case KEY_R:
+            skyRotation = skyRotation != 0.0 ? 0.0 : 0.1;
+            return true;
+        case KEY_G:
+            // The frame cap would pad EndDrawing to the budget and hide the
+            // work time, so the governor's loop waits out the frame itself
+            governQuality = !governQuality;
+            SetTargetFPS(governQuality ? 0 : TARGET_FPS);
+            governor.quality = 1.0;
+            governor.average = 0.0;
+            governor.hold = 0;
+            if (apply)
+            {
+                QualitySettings settings = governor.Current();
+                if (!governQuality)
+                    settings.trailLength = maxTrail;
+                ApplyQuality(settings);
+            }
+            return true;
+        case KEY_T:
+            // Only the speed depends on the tuning, so the rays carry on
+            autotune = !autotune;
+            (autotune ? Autotuner{}.LoadOrTune(blackHole.r_s, TIME_MULTIPLIER / TARGET_FPS) : TuneConfig{})
+                .ApplyTo(store);
+            return true;
+        default:
+            return false;
+        }
+        if (apply)
+            Launch();
+        return true;
+    }
 
-        path.push_back(pos);
+    // Current value of the setting bound to `key`, for the on-screen list.
+    std::string State(int key) const
+    {
+        auto onOff = [](bool on) { return std::string(on ? "on" : "off"); };
+        switch (key)
+        {
+        case KEY_K:
+            return Kernel() == RayKernel::Cartesian ? "Cartesian" : "polar";
+        case KEY_M:
+            return WithSpacetime(spacetime, [](auto metric) { return std::string(decltype(metric)::NAME); });
+        case KEY_C:
+            return onOff(criticalLaunch);
+        case KEY_B:
+            return std::to_string(1 << scheduler.maxLevel) + " per frame";
+        case KEY_F:
+            return farFieldRadius > 0.0 ? "beyond " + std::to_string(static_cast<int>(farFieldRadius)) + " r_s" : "off";
+        case KEY_W:
+            return onOff(windingLegs);
+        case KEY_A:
+            return onOff(useAtlas);
+        case KEY_D:
+            return onOff(rayDifferentials);
+        case KEY_N:
+            return std::to_string(fanRays) + " rays";
+        case KEY_L:
+            return onOff(lensingView);
+        case KEY_S:
+            return onOff(starCatalog);
+        case KEY_R:
+            return onOff(skyRotation != 0.0);
+        case KEY_G:
+            return governQuality ? "quality " + std::to_string(static_cast<int>(100 * governor.quality)) + "%" : "off";
+        case KEY_T:
+            return onOff(autotune);
+        default:
+            return "";
+        }
     }
-};
 
-struct Simulation
-{
-    BlackHole blackHole;
-    std::vector<LightRay> lightRays;
-    Vector2 center;
+    // Loads what the lensing view needs on its first showing, then draws it.
+    void ShowLensing()
+    {
+        if (lensTexture.id == 0)
+        {
+            if (sky.Open(skyPath))
+                lensing.sky = &sky;
+            Image image = GenImageColor(lensing.camera.width, lensing.camera.height, BLACK);
+            lensTexture = LoadTextureFromImage(image);
+            UnloadImage(image);
+        }
+        if (starCatalog && stars.catalog.empty())
+            stars.catalog = StarLensing::RandomCatalog(20000);
+        RenderLensing();
+    }
 
-    Simulation(int width, int height)
-        : blackHole(Vector2{0, 0}, 8.54e36), center{width / 2.0f, height / 2.0f}
+    // Shades the lensing view from the packed lens map, tracing only if the
+    // camera or the scene changed since it was made, and uploads it.
+    void RenderLensing()
     {
-        // int numRays = 100;
-        // int step = height / numRays;
-        // for (int i = 0; i <= height; i += step)
-        // {
-        //     // Start rays from the left edge, relative to center
-        //     LightRay ray(Vector2{-center.x, static_cast<float>(i) - center.y}, Vector2{1, 0});
-        //     lightRays.push_back(ray);
-        // }
-
-        lightRays.emplace_back(Vector2{-center.x, 285.99}, Vector2{1, 0}); // Makes a single orbit around the black hole
+        lensing.Refresh();
+        lensing.ShadePacked(static_cast<float>(skyAngle));
+        if (starCatalog)
+        {
+            stars.rotation = static_cast<float>(skyAngle);
+            stars.Splat(lensing.camera, lensing.frame, &lensing.map);
+        }
+        std::vector<Color> pixels;
+        if (postProcess)
+            post.Apply(lensing.frame, pixels);
+        else
+            lensing.frame.ToColors(pixels);
+        UpdateTexture(lensTexture, pixels.data());
     }
 
     void Update(double dt)
     {
-        for (auto &lr : lightRays)
+        for (const Switch &s : SWITCHES)
+            if (IsKeyPressed(s.key))
+                Flip(s.key);
+
+        if (lensingView)
         {
-            lr.Update(dt, blackHole.r_s); // Update each light ray's position
+            // Arrow keys orbit the camera
+            double turn = 0.5 * dt / TIME_MULTIPLIER;
+            double azimuth = lensing.camera.azimuth, inclination = lensing.camera.inclination;
+            lensing.camera.azimuth += turn * (IsKeyDown(KEY_RIGHT) - IsKeyDown(KEY_LEFT));
+            lensing.camera.inclination =
+                std::clamp(inclination + turn * (IsKeyDown(KEY_UP) - IsKeyDown(KEY_DOWN)), -1.5, 1.5);
+            skyAngle += skyRotation * dt / TIME_MULTIPLIER;
+            if (lensing.camera.azimuth != azimuth || lensing.camera.inclination != inclination || skyRotation != 0.0)
+                RenderLensing();
+            return;
         }
+
+        if (Kernel() == RayKernel::Cartesian)
+            store.Update(lightRays, dt, blackHole.r_s);
+        else
+            scheduler.Update(lightRays, dt, blackHole.r_s, farFieldRadius * blackHole.r_s); // Update each light ray's position
     }
 
     void Draw()
@@ -162,8 +431,18 @@ struct Simulation
         BeginDrawing();
         ClearBackground(BLACK);
 
+        if (lensingView)
+        {
+            Rectangle source{0, 0, static_cast<float>(lensTexture.width), static_cast<float>(lensTexture.height)};
+            Rectangle target{0, 0, 2.0f * center.x, 2.0f * center.y};
+            DrawTexturePro(lensTexture, source, target, Vector2{0, 0}, 0.0f, WHITE);
+            DrawSwitches();
+            EndDrawing();
+            return;
+        }
+
         // Draw black hole at center
-        float scaled_r_s = static_cast<float>(blackHole.r_s * VIS_SCALE);
+        float scaled_r_s = static_cast<float>(blackHole.r_s * VIS_SCALE * store.Horizon());
         DrawCircleV(center, scaled_r_s, RED); // Draw the black hole as a circle with scaled radius
 
         // Draw light rays
@@ -184,29 +463,111 @@ struct Simulation
             }
         }
 
+        DrawSwitches();
         EndDrawing();
     }
 
+    // Lists the switches and their state in the top left corner.
+    void DrawSwitches() const
+    {
+        int y = 10;
+        for (const Switch &s : SWITCHES)
+        {
+            std::string line = std::string(1, static_cast<char>(s.key)) + "  " + s.name + ": " + State(s.key);
+            DrawText(line.c_str(), 10, y, 10, GRAY);
+            y += 12;
+        }
+    }
+
+    void ApplyQuality(const QualitySettings &settings)
+    {
+        for (auto &lr : lightRays)
+        {
+            lr.maxTrail = settings.trailLength;
+            lr.trail.spacing = settings.trailSpacing;
+        }
+        scheduler.accuracy = settings.accuracy;
+        store.accuracy = settings.accuracy;
+        lensing.accuracy = settings.lensAccuracy;
+    }
+
     void Run()
     {
         while (!WindowShouldClose())
         {
+            double workStart = GetTime();
             Update(GetFrameTime() * TIME_MULTIPLIER);
             Draw();
+
+            if (governQuality)
+            {
+                double work = GetTime() - workStart; // Update, draw and present
+                if (governor.Observe(work))
+                    ApplyQuality(governor.Current());
+                double budget = 1.0 / governor.targetFps;
+                if (work < budget)
+                    WaitTime(budget - work);
+            }
         }
+
+        if (profileRays)
+            profile.Report(std::cout, 10, blackHole.r_s);
+        if (lensTexture.id != 0)
+            UnloadTexture(lensTexture); // Before CloseWindow takes the GL context
     }
 };
 
-int main()
+int main(int argc, char **argv)
 {
+    // Offline tuning: measure, write the cache file and exit
+    if (argc > 1 && std::string(argv[1]) == "--autotune")
+    {
+        // Tuned for the simulation's black hole and one step per frame
+        double r_s = BlackHole(Vector2{0, 0}, BLACK_HOLE_MASS).r_s;
+        double dt = TIME_MULTIPLIER / TARGET_FPS;
+        Autotuner tuner;
+        TuneConfig config = tuner.Tune(r_s, dt);
+        tuner.Save(config, r_s, dt);
+        std::cout << "batch " << config.batchSize << ", width " << config.simdWidth << ", threads " << config.threads
+                  << " -> " << tuner.cachePath << std::endl;
+        return 0;
+    }
+
+    // Generic (autodiff) geodesics against the specialized kernel
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-metric")
+    {
+        MetricBenchmark().Run(std::cout);
+        return 0;
+    }
+
+    // Bloom and tone mapping at 1080p over a range of thread counts, against
+    // a 5 ms budget
+    if (argc > 1 && std::string(argv[1]) == "--benchmark-post")
+        return PostProcessBenchmark().Run(std::cout) ? 0 : 1;
+
+    // Headless run of the lensing view's render, reprojection and packed paths
+    if (argc > 1 && std::string(argv[1]) == "--smoke-lensing")
+        return LensingSmoke().Run(std::cout) ? 0 : 1;
+
+    // Offline sky conversion: equirectangular image to a tiled, mipmapped file
+    if (argc > 3 && std::string(argv[1]) == "--convert-sky")
+    {
+        if (!SkyTexture::Convert(argv[2], argv[3]))
+        {
+            std::cerr << "Could not convert " << argv[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
     const int screenWidth = 1600;
     const int screenHeight = 900;
 
     InitWindow(screenWidth, screenHeight, "Black Hole Visualization");
-    SetTargetFPS(60);
+    SetTargetFPS(TARGET_FPS);
 
-    // Simulation Setup
-    Simulation sim(screenWidth, screenHeight);
+    // Simulation Setup; any other arguments are SWITCHES flags
+    Simulation sim(screenWidth, screenHeight, std::vector<std::string>(argv + 1, argv + argc));
     sim.Run();
 
     CloseWindow();
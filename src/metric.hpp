@@ -0,0 +1,183 @@
+#pragma once
+
+#include <limits>
+#include <type_traits>
+
+// Spacetimes for the Cartesian photon kernel, as policy types.
+//
+// For a static, spherically symmetric metric
+//
+//   ds² = -f(r) dt² + dr² / f(r) + r² dΩ²
+//
+// photon orbits obey u'' + u = u - (1/2) d/du [u² f(1/u)] with u = 1/r. Like
+// Schwarzschild's, that is the orbit of a central acceleration, which is
+// written as Schwarzschild's times a factor:
+//
+//   a = -k Factor(1/r) x / r^5,   k = (3/2) h²
+//
+// so the kernels keep their per-ray k and Schwarzschild (Factor = 1) compiles
+// to exactly the hand-written code. FactorSlope is dFactor/du, which the ray
+// differentials need, and Bending is 3 ∫₀ᵘ Factor(s) s² ds, the metric's term in
+// the first integral (du/dφ)² = 1/b² - u² + Bending(u) of the orbit; it gives
+// the conserved energy and b_crit. Each policy also gives the radii the integrators stop
+// at. All lengths are in r_s = 2GM/c², and every coefficient
+// is a compile-time constant: kernels are instantiated per metric and have no
+// run-time switch inside the loop.
+
+// Newton's square root, for constants.
+constexpr double ConstexprSqrt(double x)
+{
+    if (x <= 0.0)
+        return 0.0;
+    double r = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 100; ++i)
+        r = 0.5 * (r + x / r);
+    return r;
+}
+
+// f(r) = 1 - 1/r.
+struct Schwarzschild
+{
+    static constexpr const char *NAME = "Schwarzschild";
+    static constexpr double HORIZON = 1.0;
+    static constexpr double PHOTON_SPHERE = 1.5;
+    static constexpr double OUTER = std::numeric_limits<double>::infinity(); // Cosmological horizon
+
+    template <typename Real>
+    static constexpr Real Factor(Real)
+    {
+        return Real(1);
+    }
+
+    template <typename Real>
+    static constexpr Real FactorSlope(Real)
+    {
+        return Real(0);
+    }
+
+    template <typename Real>
+    static constexpr Real Bending(Real u)
+    {
+        return u * u * u;
+    }
+};
+
+// Charged hole: f(r) = 1 - 1/r + Q²/r², with Q in r_s (Q < 1/2). The charge
+// repels at short range, pulling the horizon and the photon sphere inwards:
+// u'' + u = (3/2) u² - 2 Q² u³.
+template <double Charge = 0.4>
+struct ReissnerNordstrom
+{
+    static_assert(Charge >= 0.0 && Charge < 0.5, "Beyond Q = r_s/2 there is no horizon");
+
+    static constexpr const char *NAME = "Reissner-Nordstrom";
+    static constexpr double Q2 = Charge * Charge;
+    static constexpr double HORIZON = 0.5 * (1.0 + ConstexprSqrt(1.0 - 4.0 * Q2));
+    static constexpr double PHOTON_SPHERE = 0.25 * (3.0 + ConstexprSqrt(9.0 - 32.0 * Q2));
+    static constexpr double OUTER = std::numeric_limits<double>::infinity();
+
+    template <typename Real>
+    static constexpr Real Factor(Real u)
+    {
+        return Real(1) - Real(4.0 / 3.0 * Q2) * u;
+    }
+
+    template <typename Real>
+    static constexpr Real FactorSlope(Real)
+    {
+        return -Real(4.0 / 3.0 * Q2);
+    }
+
+    template <typename Real>
+    static constexpr Real Bending(Real u)
+    {
+        return u * u * u * (Real(1) - Real(Q2) * u);
+    }
+};
+
+// Hole in an expanding universe: f(r) = 1 - 1/r - Λ r²/3, with Λ in r_s⁻².
+// Λ drops out of the orbit equation, so rays bend exactly as in
+// Schwarzschild; what changes is that space ends at the cosmological horizon
+// and rays must be counted as escaped well inside it.
+template <double Lambda = 1e-4>
+struct SchwarzschildDeSitter
+{
+    static_assert(Lambda > 0.0 && Lambda < 4.0 / 27.0, "Beyond 4/27 the two horizons merge");
+
+    static constexpr const char *NAME = "Schwarzschild-de Sitter";
+
+    // Roots of f, by Newton's method from either side
+    static constexpr double Root(double r)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            double f = 1.0 - 1.0 / r - Lambda * r * r / 3.0;
+            double df = 1.0 / (r * r) - 2.0 * Lambda * r / 3.0;
+            r -= f / df;
+        }
+        return r;
+    }
+
+    static constexpr double HORIZON = Root(1.0);
+    static constexpr double PHOTON_SPHERE = 1.5;
+    static constexpr double OUTER = Root(ConstexprSqrt(3.0 / Lambda));
+
+    template <typename Real>
+    static constexpr Real Factor(Real)
+    {
+        return Real(1);
+    }
+
+    template <typename Real>
+    static constexpr Real FactorSlope(Real)
+    {
+        return Real(0);
+    }
+
+    template <typename Real>
+    static constexpr Real Bending(Real u)
+    {
+        return u * u * u;
+    }
+};
+
+// Metrics selectable at run time. Code switches on this once per batch or
+// band and runs a kernel instantiated for the chosen policy.
+enum class Spacetime
+{
+    Schwarzschild,
+    ReissnerNordstrom,
+    SchwarzschildDeSitter,
+};
+
+constexpr int SPACETIMES = 3;
+
+// Calls fn(Policy{}) for the policy type of `spacetime`.
+template <typename Fn>
+decltype(auto) WithSpacetime(Spacetime spacetime, Fn &&fn)
+{
+    switch (spacetime)
+    {
+    case Spacetime::ReissnerNordstrom:
+        return fn(ReissnerNordstrom<>{});
+    case Spacetime::SchwarzschildDeSitter:
+        return fn(SchwarzschildDeSitter<>{});
+    default:
+        return fn(Schwarzschild{});
+    }
+}
+
+// The Spacetime WithSpacetime dispatches to policy Metric with.
+template <typename Metric>
+constexpr Spacetime SpacetimeOf()
+{
+    if constexpr (std::is_same_v<Metric, ReissnerNordstrom<>>)
+        return Spacetime::ReissnerNordstrom;
+    else if constexpr (std::is_same_v<Metric, SchwarzschildDeSitter<>>)
+        return Spacetime::SchwarzschildDeSitter;
+    else
+    {
+        static_assert(std::is_same_v<Metric, Schwarzschild>, "Metric has no Spacetime to select it at run time");
+        return Spacetime::Schwarzschild;
+    }
+}
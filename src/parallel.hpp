@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller does not specify one.
+inline unsigned DefaultThreadCount()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Worker threads that live for the whole program, so that a parallel pass
+// costs a wake-up and a wait rather than creating and joining threads. The
+// renderers and the post-processing run some twenty passes per frame, where
+// thread creation alone would eat most of the budget. Threads are started on
+// first use, as many as the widest pass asked for.
+struct WorkerPool
+{
+    static WorkerPool &Shared()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    // Runs job() on `threads` threads, the calling thread being one of them,
+    // and returns once every call has returned. Returns false without running
+    // anything while the pool is busy, that is for a pass started from inside
+    // another pass or from a second thread; the caller then runs it alone.
+    template <typename Job>
+    bool Run(unsigned threads, Job &job)
+    {
+        std::unique_lock<std::mutex> busy(runMutex, std::try_to_lock);
+        if (!busy.owns_lock())
+            return false;
+
+        unsigned helpers = threads > 0 ? threads - 1 : 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (workers.size() < helpers)
+                workers.emplace_back(&WorkerPool::Work, this, static_cast<unsigned>(workers.size()), generation);
+            context = &job;
+            invoke = [](void *j) { (*static_cast<Job *>(j))(); };
+            wanted = helpers;
+            pending = helpers;
+            ++generation;
+        }
+        wake.notify_all();
+
+        job();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return pending == 0; });
+        return true;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex runMutex; // Held for the duration of a Run
+    std::mutex mutex;    // Guards everything below
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    unsigned wanted = 0, pending = 0;
+    void *context = nullptr;
+    void (*invoke)(void *) = nullptr;
+    bool stop = false;
+
+    void Work(unsigned index, uint64_t seen)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;)
+        {
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+            if (index >= wanted)
+                continue;
+
+            void *job = context;
+            void (*call)(void *) = invoke;
+            lock.unlock();
+            call(job);
+            lock.lock();
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+};
+
+// Runs fn(i) for every i in [0, count), spread over `threads` threads (0 picks
+// the hardware concurrency) of the shared WorkerPool. Indices are handed out
+// in chunks of `chunk` so threads that draw cheap work simply take more of it.
+// Blocks until done. Nested calls run on the calling thread.
+template <typename Fn>
+void ParallelFor(size_t count, Fn &&fn, unsigned threads = 0, size_t chunk = 1)
+{
+    if (threads == 0)
+        threads = DefaultThreadCount();
+    chunk = std::max<size_t>(chunk, 1);
+    threads = static_cast<unsigned>(std::min<size_t>(threads, (count + chunk - 1) / chunk));
+
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            size_t begin = next.fetch_add(chunk);
+            if (begin >= count)
+                return;
+            size_t end = std::min(begin + chunk, count);
+            for (size_t i = begin; i < end; ++i)
+                fn(i);
+        }
+    };
+
+    if (!WorkerPool::Shared().Run(threads, worker))
+        worker();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "raylib.h"
+
+const double c = 299792458.0f; // Speed of light in m/s
+const double G = 6.67430e-11f; // Gravitational constant in m^3 kg^-1 s^-2
+const double VIS_SCALE = 6e-9; // Visualization scale: meters to pixels
+
+struct BlackHole
+{
+    Vector2 pos;
+    double mass;
+
+    double r_s; // Schwarzschild radius
+
+    BlackHole(Vector2 position, double m)
+        : pos(position), mass(m)
+    {
+        r_s = (2 * G * mass) / (c * c); // Calculate Schwarzschild radius
+    }
+};
@@ -0,0 +1,403 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "lensing_renderer.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+// Float image with each colour channel in its own plane, so filter loops run
+// over plain contiguous floats and vectorize.
+struct PlanarImage
+{
+    int width = 0, height = 0;
+    std::vector<float> data; // Red plane, then green, then blue
+
+    void Resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        data.assign(static_cast<size_t>(w) * h * 3, 0.0f);
+    }
+
+    float *Row(int channel, int y) { return data.data() + (static_cast<size_t>(channel) * height + y) * width; }
+    const float *Row(int channel, int y) const
+    {
+        return data.data() + (static_cast<size_t>(channel) * height + y) * width;
+    }
+};
+
+// Wall time of each kind of pass in one PostProcess::Apply (seconds).
+struct PostProcessTiming
+{
+    double brightPass = 0.0, downsample = 0.0, blur = 0.0, upsample = 0.0, composite = 0.0;
+
+    double Total() const { return brightPass + downsample + blur + upsample + composite; }
+};
+
+enum class ToneMap
+{
+    Reinhard, // x / (1 + x), as Framebuffer::ToColors
+    Aces,     // Filmic curve (Narkowicz's fit to ACES)
+};
+
+// Bloom and tone mapping for the HDR framebuffer, on the CPU.
+//
+// Bloom is a blur pyramid rather than one wide kernel: the bright part of
+// the frame is box-downsampled to half size and on down to a few pixels,
+// every level gets the same small separable blur (binomial, 5 taps), and the
+// levels are added back up from the coarsest with bilinear upsampling. The
+// widest level reaches across much of the frame, yet the work is a few passes
+// over a half-size image. Every pass runs over rows or bands of rows on all
+// threads; the horizontal and vertical blur are fused per band (each band
+// blurs two extra rows horizontally on either side), so a level's blur costs
+// one pass through the WorkerPool. The final pass adds the bloom to the
+// frame, applies exposure and the tone curve, and gamma-encodes via a table.
+struct PostProcess
+{
+    float threshold = 1.0f; // Luminance at which pixels start to bloom
+    float intensity = 0.4f; // Weight of the bloom added back, shared between the levels
+    int levels = 6;         // Pyramid levels from half resolution down, at most
+    float exposure = 1.0f;
+    ToneMap toneMap = ToneMap::Aces;
+    unsigned threads = 0;   // 0 uses the hardware concurrency
+    int bandRows = 16;
+
+    std::vector<PlanarImage> down; // Bright pass, half size and smaller
+    std::vector<PlanarImage> blur; // Blurred levels, then the accumulated bloom
+
+    PostProcessTiming *timing = nullptr; // Per-pass times of the last Apply, if set
+
+    // Rows per work item for images `width` pixels wide: enough that the
+    // small pyramid levels stay on one thread instead of waking the workers.
+    static size_t Grain(int width) { return std::max(1, 16384 / width); }
+
+    // Post-processes frame into 8-bit RGBA.
+    void Apply(const Framebuffer &frame, std::vector<Color> &out)
+    {
+        int w = frame.width, h = frame.height;
+        out.resize(static_cast<size_t>(w) * h);
+        if (w < 2 || h < 2)
+        {
+            frame.ToColors(out);
+            return;
+        }
+
+        // Pyramid shape
+        int count = 1;
+        while (count < levels && std::max(1, w >> (count + 1)) >= 4 && std::max(1, h >> (count + 1)) >= 4)
+            ++count;
+        down.resize(count);
+        blur.resize(count);
+        for (int l = 0; l < count; ++l)
+        {
+            int lw = std::max(1, w >> (l + 1)), lh = std::max(1, h >> (l + 1));
+            if (down[l].width != lw || down[l].height != lh)
+            {
+                down[l].Resize(lw, lh);
+                blur[l].Resize(lw, lh);
+            }
+        }
+
+        auto mark = std::chrono::steady_clock::now();
+        auto lap = [&](double PostProcessTiming::*pass)
+        {
+            if (!timing)
+                return;
+            auto now = std::chrono::steady_clock::now();
+            timing->*pass = std::chrono::duration<double>(now - mark).count();
+            mark = now;
+        };
+
+        BrightPass(frame, down[0]);
+        lap(&PostProcessTiming::brightPass);
+        for (int l = 1; l < count; ++l)
+            Downsample(down[l - 1], down[l]);
+        lap(&PostProcessTiming::downsample);
+        for (int l = 0; l < count; ++l)
+            Blur(down[l], blur[l]);
+        lap(&PostProcessTiming::blur);
+        for (int l = count - 1; l > 0; --l)
+            UpsampleAdd(blur[l], blur[l - 1]);
+        lap(&PostProcessTiming::upsample);
+        Composite(frame, blur[0], intensity / count, out);
+        lap(&PostProcessTiming::composite);
+    }
+
+    // Half-size copy of the frame keeping only what is above threshold,
+    // with a soft knee: each pixel is scaled by (lum - threshold) / lum.
+    void BrightPass(const Framebuffer &frame, PlanarImage &dst) const
+    {
+        ParallelFor(
+            dst.height,
+            [&](size_t row)
+            {
+                int y = static_cast<int>(row);
+                int y0 = std::min(2 * y, frame.height - 1), y1 = std::min(2 * y + 1, frame.height - 1);
+                const float *a = frame.rgb.data() + static_cast<size_t>(y0) * frame.width * 3;
+                const float *b = frame.rgb.data() + static_cast<size_t>(y1) * frame.width * 3;
+                float *r = dst.Row(0, y), *g = dst.Row(1, y), *bl = dst.Row(2, y);
+                for (int x = 0; x < dst.width; ++x)
+                {
+                    int i0 = 3 * std::min(2 * x, frame.width - 1), i1 = 3 * std::min(2 * x + 1, frame.width - 1);
+                    float cr = 0.25f * (a[i0] + a[i1] + b[i0] + b[i1]);
+                    float cg = 0.25f * (a[i0 + 1] + a[i1 + 1] + b[i0 + 1] + b[i1 + 1]);
+                    float cb = 0.25f * (a[i0 + 2] + a[i1 + 2] + b[i0 + 2] + b[i1 + 2]);
+                    float lum = 0.2126f * cr + 0.7152f * cg + 0.0722f * cb;
+                    float keep = std::max(lum - threshold, 0.0f) / std::max(lum, 1e-6f);
+                    r[x] = cr * keep;
+                    g[x] = cg * keep;
+                    bl[x] = cb * keep;
+                }
+            },
+            threads, Grain(dst.width));
+    }
+
+    // 2x2 box filter.
+    void Downsample(const PlanarImage &src, PlanarImage &dst) const
+    {
+        ParallelFor(
+            dst.height,
+            [&](size_t row)
+            {
+                int y = static_cast<int>(row);
+                int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float *a = src.Row(c, y0), *b = src.Row(c, y1);
+                    float *out = dst.Row(c, y);
+                    int pairs = std::min(dst.width, src.width / 2);
+                    for (int x = 0; x < pairs; ++x)
+                        out[x] = 0.25f * (a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1]);
+                    for (int x = pairs; x < dst.width; ++x)
+                        out[x] = 0.5f * (a[src.width - 1] + b[src.width - 1]);
+                }
+            },
+            threads, Grain(dst.width));
+    }
+
+    // Separable [1 4 6 4 1] / 16 blur of src into dst, edges clamped.
+    void Blur(const PlanarImage &src, PlanarImage &dst) const
+    {
+        int w = src.width, h = src.height;
+        int bands = (h + bandRows - 1) / bandRows;
+        ParallelFor(
+            bands,
+            [&](size_t band)
+            {
+                int y0 = static_cast<int>(band) * bandRows, y1 = std::min(y0 + bandRows, h);
+                int t0 = std::max(0, y0 - 2), t1 = std::min(h, y1 + 2);
+                std::vector<float> padded(w + 4), rows(static_cast<size_t>(t1 - t0) * w);
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    // Horizontal, into rows [t0, t1)
+                    for (int y = t0; y < t1; ++y)
+                    {
+                        const float *in = src.Row(c, y);
+                        std::copy(in, in + w, padded.begin() + 2);
+                        padded[0] = padded[1] = in[0];
+                        padded[w + 2] = padded[w + 3] = in[w - 1];
+                        const float *p = padded.data();
+                        float *out = rows.data() + static_cast<size_t>(y - t0) * w;
+                        for (int x = 0; x < w; ++x)
+                            out[x] = (p[x] + 4.0f * p[x + 1] + 6.0f * p[x + 2] + 4.0f * p[x + 3] + p[x + 4]) *
+                                     (1.0f / 16.0f);
+                    }
+
+                    // Vertical, into the band
+                    auto at = [&](int y) { return rows.data() + static_cast<size_t>(std::clamp(y, t0, t1 - 1) - t0) * w; };
+                    for (int y = y0; y < y1; ++y)
+                    {
+                        const float *a = at(y - 2), *b = at(y - 1), *m = at(y), *d = at(y + 1), *e = at(y + 2);
+                        float *out = dst.Row(c, y);
+                        for (int x = 0; x < w; ++x)
+                            out[x] = (a[x] + 4.0f * b[x] + 6.0f * m[x] + 4.0f * d[x] + e[x]) * (1.0f / 16.0f);
+                    }
+                }
+            },
+            threads, (Grain(w) + bandRows - 1) / bandRows);
+    }
+
+    // Source and weight columns for bilinear 2x upsampling into `width`
+    // pixels from `srcWidth`.
+    static void UpsampleTaps(int width, int srcWidth, std::vector<int> &x0, std::vector<int> &x1,
+                             std::vector<float> &fx)
+    {
+        x0.resize(width);
+        x1.resize(width);
+        fx.resize(width);
+        for (int x = 0; x < width; ++x)
+        {
+            float s = std::clamp(0.5f * (x + 0.5f) - 0.5f, 0.0f, static_cast<float>(srcWidth - 1));
+            x0[x] = static_cast<int>(s);
+            x1[x] = std::min(x0[x] + 1, srcWidth - 1);
+            fx[x] = s - x0[x];
+        }
+    }
+
+    // dst += bilinear 2x upsample of src.
+    void UpsampleAdd(const PlanarImage &src, PlanarImage &dst) const
+    {
+        std::vector<int> x0, x1;
+        std::vector<float> fx;
+        UpsampleTaps(dst.width, src.width, x0, x1, fx);
+        ParallelFor(
+            dst.height,
+            [&](size_t row)
+            {
+                int y = static_cast<int>(row);
+                float s = std::clamp(0.5f * (y + 0.5f) - 0.5f, 0.0f, static_cast<float>(src.height - 1));
+                int sy0 = static_cast<int>(s), sy1 = std::min(sy0 + 1, src.height - 1);
+                float fy = s - sy0;
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float *a = src.Row(c, sy0), *b = src.Row(c, sy1);
+                    float *out = dst.Row(c, y);
+                    for (int x = 0; x < dst.width; ++x)
+                    {
+                        float top = a[x0[x]] + fx[x] * (a[x1[x]] - a[x0[x]]);
+                        float bottom = b[x0[x]] + fx[x] * (b[x1[x]] - b[x0[x]]);
+                        out[x] += top + fy * (bottom - top);
+                    }
+                }
+            },
+            threads, Grain(dst.width));
+    }
+
+    // frame + bloom, exposed, tone mapped and gamma encoded. Each row is
+    // built as contiguous floats (the bloom upsampled and interleaved to the
+    // frame's layout) so the tone curve runs as one vector loop.
+    void Composite(const Framebuffer &frame, const PlanarImage &bloom, float weight, std::vector<Color> &out) const
+    {
+        static const std::vector<uint8_t> gamma = []()
+        {
+            std::vector<uint8_t> table(4096);
+            for (size_t i = 0; i < table.size(); ++i)
+                table[i] = static_cast<uint8_t>(std::lround(255.0f * std::pow(i / 4095.0f, 1.0f / 2.2f)));
+            return table;
+        }();
+
+        std::vector<int> x0, x1;
+        std::vector<float> fx;
+        UpsampleTaps(frame.width, bloom.width, x0, x1, fx);
+        ParallelFor(
+            frame.height,
+            [&](size_t row)
+            {
+                int y = static_cast<int>(row), w = frame.width;
+                float s = std::clamp(0.5f * (y + 0.5f) - 0.5f, 0.0f, static_cast<float>(bloom.height - 1));
+                int sy0 = static_cast<int>(s), sy1 = std::min(sy0 + 1, bloom.height - 1);
+                float fy = s - sy0;
+
+                thread_local std::vector<float> column, line;
+                column.resize(bloom.width);
+                line.resize(static_cast<size_t>(w) * 3);
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float *a = bloom.Row(c, sy0), *b = bloom.Row(c, sy1);
+                    for (int x = 0; x < bloom.width; ++x)
+                        column[x] = a[x] + fy * (b[x] - a[x]);
+                    for (int x = 0; x < w; ++x)
+                        line[3 * x + c] = column[x0[x]] + fx[x] * (column[x1[x]] - column[x0[x]]);
+                }
+
+                const float *in = frame.rgb.data() + static_cast<size_t>(y) * w * 3;
+                float *v = line.data();
+                size_t n = line.size();
+                for (size_t i = 0; i < n; ++i)
+                    v[i] = exposure * (in[i] + weight * v[i]);
+                if (toneMap == ToneMap::Aces)
+                    for (size_t i = 0; i < n; ++i)
+                        v[i] = v[i] * (2.51f * v[i] + 0.03f) / (v[i] * (2.43f * v[i] + 0.59f) + 0.14f);
+                else
+                    for (size_t i = 0; i < n; ++i)
+                        v[i] = v[i] / (1.0f + v[i]);
+                for (size_t i = 0; i < n; ++i)
+                    v[i] = std::min(std::max(v[i], 0.0f), 1.0f) * 4095.0f + 0.5f;
+
+                Color *dst = out.data() + static_cast<size_t>(y) * w;
+                for (int x = 0; x < w; ++x)
+                    dst[x] = Color{gamma[static_cast<int>(v[3 * x])], gamma[static_cast<int>(v[3 * x + 1])],
+                                   gamma[static_cast<int>(v[3 * x + 2])], 255};
+            },
+            threads, Grain(frame.width));
+    }
+};
+
+// Times PostProcess::Apply on a synthetic HDR frame (a dim gradient with a
+// grid of bright spots, so the bloom has something to spread) at every
+// thread count from one up to the hardware's, doubling. The fastest of
+// `repeats` runs counts, after one untimed run that sizes the pyramid and
+// starts the workers, and is printed with its time per kind of pass. Returns
+// whether the run on all hardware threads fits in `budget`.
+struct PostProcessBenchmark
+{
+    int width = 1920, height = 1080;
+    int repeats = 20;
+    double budget = 5e-3; // Seconds per frame
+
+    bool Run(std::ostream &out) const
+    {
+        Framebuffer frame;
+        frame.Resize(width, height);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+            {
+                float base = 0.2f * x / width + 0.1f * y / height;
+                bool spot = x % 160 < 6 && y % 120 < 6;
+                frame.Set(static_cast<size_t>(y) * width + x, Vector3{base + spot * 8.0f, base + spot * 6.0f, base});
+            }
+
+        std::vector<unsigned> threadCounts;
+        for (unsigned t = 1; t < DefaultThreadCount(); t *= 2)
+            threadCounts.push_back(t);
+        threadCounts.push_back(DefaultThreadCount());
+
+        out << width << 'x' << height << ", " << DefaultThreadCount() << " hardware threads\n";
+        std::vector<Color> pixels;
+        double fastest = std::numeric_limits<double>::infinity();
+        for (unsigned threads : threadCounts)
+        {
+            PostProcess post;
+            PostProcessTiming timing, best;
+            post.threads = threads;
+            post.timing = &timing;
+            post.Apply(frame, pixels);
+            fastest = std::numeric_limits<double>::infinity();
+            for (int i = 0; i < repeats; ++i)
+            {
+                auto start = std::chrono::steady_clock::now();
+                post.Apply(frame, pixels);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (seconds < fastest)
+                {
+                    fastest = seconds;
+                    best = timing;
+                }
+            }
+            char line[160];
+            std::snprintf(line, sizeof(line),
+                          "threads %3u: %7.2f ms (bright %.2f, downsample %.2f, blur %.2f, upsample %.2f, "
+                          "composite %.2f)\n",
+                          threads, 1e3 * fastest, 1e3 * best.brightPass, 1e3 * best.downsample, 1e3 * best.blur,
+                          1e3 * best.upsample, 1e3 * best.composite);
+            out << line;
+        }
+
+        bool fits = fastest <= budget;
+        char line[80];
+        std::snprintf(line, sizeof(line), "budget %.2f ms on %u threads: %s\n", 1e3 * budget, threadCounts.back(),
+                      fits ? "PASS" : "FAIL");
+        out << line;
+        return fits;
+    }
+};
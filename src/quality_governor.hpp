@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+// Settings the governor trades for frame time.
+struct QualitySettings
+{
+    size_t trailLength = 0;    // Trail points kept per ray (0 keeps all)
+    double trailSpacing = 3.0; // Pixels between trail points
+    double accuracy = 0.01;    // Step size as a fraction of the local length scale
+    double lensAccuracy = 0.04; // The lensing view's step, as LensingRenderer::accuracy
+};
+
+// Feedback controller that holds a target frame rate by lowering quality when
+// frames run long and raising it again when there is headroom.
+//
+// It watches the time spent on work each frame, presenting included but not
+// the wait for the frame cap, through an exponential average. Quality is a
+// single level in [minQuality, 1]: trails get shorter and sparser and the
+// integrators, the lensing view's included, coarser as it falls, all scaled
+// from the full-quality settings.
+// Lowering is quick and raising is slow, with a hold time after every change,
+// so it settles instead of oscillating around the budget. Ray count is left
+// alone: dropping rays would change what is simulated, not just how well.
+struct QualityGovernor
+{
+    double targetFps = 60.0;
+    double smoothing = 0.1;  // Weight of the newest frame in the average
+    double headroom = 0.7;   // Raise quality while work stays under this share of the budget
+    double minQuality = 0.2;
+    int holdFrames = 30;     // Frames to wait after a change before judging it
+
+    QualitySettings full;    // Settings at quality 1
+
+    double quality = 1.0;
+    double average = 0.0;    // Smoothed work time per frame (seconds)
+    int hold = 0;
+
+    // Feeds the work time of the last frame. Returns true if quality changed.
+    bool Observe(double workSeconds)
+    {
+        average = average > 0.0 ? average + smoothing * (workSeconds - average) : workSeconds;
+        if (hold > 0)
+        {
+            --hold;
+            return false;
+        }
+
+        double budget = 1.0 / targetFps;
+        double previous = quality;
+        if (average > budget)
+            quality = std::max(minQuality, quality * std::max(0.5, 0.9 * budget / average)); // Cut to 90% of budget
+        else if (average < headroom * budget)
+            quality = std::min(1.0, quality * 1.05);
+
+        if (quality == previous)
+            return false;
+        hold = holdFrames;
+        return true;
+    }
+
+    // Settings at the current quality level.
+    QualitySettings Current() const
+    {
+        QualitySettings s = full;
+        if (full.trailLength > 0)
+            s.trailLength = std::max<size_t>(16, static_cast<size_t>(full.trailLength * quality));
+        s.trailSpacing = full.trailSpacing / quality;
+        s.accuracy = full.accuracy / quality;
+        s.lensAccuracy = full.lensAccuracy / quality;
+        return s;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "light_ray.hpp"
+#include "physics.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+// Integration cost of one ray since profiling started.
+struct RayCost
+{
+    Vector2 launchPos{0, 0}; // Position (pixels) and direction when first seen
+    Vector2 launchDir{1, 0};
+    long steps = 0;
+    long rejected = 0;    // Steps that had to be redone finer (block-step refinements)
+    double seconds = 0.0; // Estimated CPU time
+};
+
+// Per-ray cost attribution for the integrators. Step counts are exact; CPU
+// time is measured for one in sampleEvery single-ray updates and scaled up,
+// which keeps the clock reads out of the hot loop. Batched updates cost a
+// clock read per batch and are shared evenly between its rays.
+struct RayProfile
+{
+    int sampleEvery = 16;
+
+    std::vector<RayCost> costs; // By index into the simulation's ray list
+    long counter = 0;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Starts tracking rays not seen before.
+    void Track(const std::vector<LightRay> &rays)
+    {
+        size_t first = costs.size();
+        if (rays.size() <= first)
+            return;
+        costs.resize(rays.size());
+        for (size_t i = first; i < rays.size(); ++i)
+        {
+            costs[i].launchPos = rays[i].pos;
+            costs[i].launchDir = rays[i].dir;
+        }
+    }
+
+    // Whether to time the next single-ray update.
+    bool Sample() { return sampleEvery > 0 && counter++ % sampleEvery == 0; }
+
+    void Step(int id, long count = 1) { costs[id].steps += count; }
+    void Reject(int id) { ++costs[id].rejected; }
+
+    // Charges a sampled update.
+    void Charge(int id, Clock::time_point start)
+    {
+        costs[id].seconds += std::chrono::duration<double>(Clock::now() - start).count() * sampleEvery;
+    }
+
+    // Charges seconds spent on a batch of rays.
+    void Share(const int *ids, size_t count, double seconds)
+    {
+        if (count == 0)
+            return;
+        double each = seconds / count;
+        for (size_t i = 0; i < count; ++i)
+            costs[ids[i]].seconds += each;
+    }
+
+    // Indices of the k most expensive rays, most expensive first.
+    std::vector<int> Top(size_t k) const
+    {
+        std::vector<int> order(costs.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = static_cast<int>(i);
+        k = std::min(k, order.size());
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                          [&](int a, int b) { return costs[a].seconds > costs[b].seconds; });
+        order.resize(k);
+        return order;
+    }
+
+    // Prints the k most expensive rays with their launch conditions and
+    // impact parameter (r_s in meters), and the share of time they took.
+    void Report(std::ostream &out, size_t k, double r_s) const
+    {
+        double total = 0.0;
+        for (const auto &cost : costs)
+            total += cost.seconds;
+
+        double topTotal = 0.0;
+        std::vector<int> top = Top(k);
+        out << "Most expensive " << top.size() << " of " << costs.size() << " rays:\n";
+        for (int id : top)
+        {
+            const RayCost &cost = costs[id];
+            topTotal += cost.seconds;
+            double b = std::abs(cost.launchPos.x * cost.launchDir.y - cost.launchPos.y * cost.launchDir.x) /
+                       (r_s * VIS_SCALE);
+            out << "  ray " << id << ": " << cost.seconds * 1e3 << " ms, " << cost.steps << " steps, "
+                << cost.rejected << " rejected, from (" << cost.launchPos.x << ", " << cost.launchPos.y
+                << ") px along (" << cost.launchDir.x << ", " << cost.launchDir.y << "), b = " << b << " r_s\n";
+        }
+        if (total > 0.0)
+            out << "  " << 100.0 * topTotal / total << "% of " << total * 1e3 << " ms total\n";
+    }
+};
@@ -0,0 +1,420 @@
+#pragma once
+
+#include "raylib.h"
+
+#include "cartesian_kernel.hpp"
+#include "light_ray.hpp"
+#include "parallel.hpp"
+#include "physics.hpp"
+#include "ray_profile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// Rays on the Cartesian kernel, stored as one array per component so that
+// StepCartesian runs over a whole batch at once. Lengths are in r_s and
+// velocities in c.
+template <typename Real>
+struct RayBatch
+{
+    std::vector<Real> x, y, vx, vy, ax, ay, k;
+    std::vector<Real> jx, jy, jvx, jvy, jax, jay, dk; // Ray differentials, see CartesianState
+    std::vector<double> e0; // Launch energy, kept in double whatever Real is
+    std::vector<int> ray;   // Index of each entry in the simulation's ray list
+    std::vector<int> level; // Steps per frame are 2^level
+
+    bool differentials = false; // Whether the differential arrays are in use; set while empty
+
+    size_t Size() const { return ray.size(); }
+
+    // Calls fn on every per-entry array in use.
+    template <typename Fn>
+    void ForEach(Fn &&fn)
+    {
+        fn(x), fn(y), fn(vx), fn(vy), fn(ax), fn(ay), fn(k);
+        if (differentials)
+            fn(jx), fn(jy), fn(jvx), fn(jvy), fn(jax), fn(jay), fn(dk);
+        fn(e0), fn(ray), fn(level);
+    }
+
+    void Push(const CartesianState &s, int id, int stepLevel = 0)
+    {
+        x.push_back(static_cast<Real>(s.x));
+        y.push_back(static_cast<Real>(s.y));
+        vx.push_back(static_cast<Real>(s.vx));
+        vy.push_back(static_cast<Real>(s.vy));
+        ax.push_back(static_cast<Real>(s.ax));
+        ay.push_back(static_cast<Real>(s.ay));
+        k.push_back(static_cast<Real>(s.k));
+        if (differentials)
+        {
+            jx.push_back(static_cast<Real>(s.jx));
+            jy.push_back(static_cast<Real>(s.jy));
+            jvx.push_back(static_cast<Real>(s.jvx));
+            jvy.push_back(static_cast<Real>(s.jvy));
+            jax.push_back(static_cast<Real>(s.jax));
+            jay.push_back(static_cast<Real>(s.jay));
+            dk.push_back(static_cast<Real>(s.dk));
+        }
+        e0.push_back(s.e0);
+        ray.push_back(id);
+        level.push_back(stepLevel);
+    }
+
+    // Copies entry i into s, leaving the fields the batch does not store.
+    void Load(size_t i, CartesianState &s) const
+    {
+        s.ready = true;
+        s.x = x[i];
+        s.y = y[i];
+        s.vx = vx[i];
+        s.vy = vy[i];
+        s.ax = ax[i];
+        s.ay = ay[i];
+        s.k = k[i];
+        if (differentials)
+        {
+            s.jx = jx[i];
+            s.jy = jy[i];
+            s.jvx = jvx[i];
+            s.jvy = jvy[i];
+            s.jax = jax[i];
+            s.jay = jay[i];
+            s.dk = dk[i];
+        }
+        s.e0 = e0[i];
+    }
+
+    // Moves entry `from` to `to` (to <= from); with Truncate, removes entries
+    // without disturbing the order of the rest.
+    void Move(size_t from, size_t to)
+    {
+        ForEach([&](auto &values) { values[to] = values[from]; });
+    }
+
+    void Truncate(size_t size)
+    {
+        ForEach([&](auto &values) { values.resize(size); });
+    }
+
+    // Reorders the entries so that entry i becomes the old entry order[i].
+    void Permute(const std::vector<size_t> &order)
+    {
+        ForEach([&](auto &values)
+                {
+                    auto old = values;
+                    for (size_t i = 0; i < order.size(); ++i)
+                        values[i] = old[order[i]];
+                });
+    }
+
+    // Steps entries [begin, end), carrying the differentials if in use.
+    template <typename Metric = Schwarzschild>
+    void Step(Real dt, size_t begin, size_t end, int width = 0)
+    {
+        if (differentials)
+        {
+            StepCartesianDifferential<Real, Metric>(end - begin, x.data() + begin, y.data() + begin,
+                                                    vx.data() + begin, vy.data() + begin, ax.data() + begin,
+                                                    ay.data() + begin, k.data() + begin, jx.data() + begin,
+                                                    jy.data() + begin, jvx.data() + begin, jvy.data() + begin,
+                                                    jax.data() + begin, jay.data() + begin, dk.data() + begin, dt);
+            return;
+        }
+        StepCartesianWidth<Real, Metric>(width, end - begin, x.data() + begin, y.data() + begin, vx.data() + begin,
+                                         vy.data() + begin, ax.data() + begin, ay.data() + begin, k.data() + begin,
+                                         dt);
+    }
+
+    void Step(Real dt) { Step(dt, 0, Size()); }
+};
+
+// Owns the state of every ray on the Cartesian kernel and steps it in
+// batches, writing positions, dense output and trails back to the LightRays
+// once per frame.
+//
+// Rays run in single precision unless they need more: a ray is promoted to
+// the double batch once it comes within promoteRadius of the hole, once its
+// impact parameter is within criticalBand of b_crit (where float roundoff
+// decides between capture and escape), or once its energy has drifted by
+// more than driftTolerance. With demote set, promoted rays that have moved
+// back out past demoteRadius and are not near-critical return to float.
+//
+// Each ray takes 2^level steps per frame, the level chosen like
+// BlockScheduler's from its distance to the horizon. The kernel runs over
+// runs of entries that share a level, so every lane in a vector does the same
+// work. As rays move their levels change and the runs fragment. Every
+// sortEvery frames, a batch whose runs have become shorter than minRun on
+// average is re-sorted by outcome, level and radius band (the integer part of
+// log2 r), which restores long runs and keeps rays that will need the same
+// levels next to each other. The sort is a single counting pass over small
+// integer keys.
+//
+// Runs are cut into chunks of batchSize rays that take all of their steps
+// for the frame in one go while the chunk is in cache, spread over `threads`
+// threads. The best batch size, kernel width and thread count depend on the
+// machine; Autotuner measures them.
+struct RayStore
+{
+    int maxLevel = 4;       // At most 2^maxLevel steps per frame
+    double accuracy = 0.01; // Largest step as a fraction of the distance to the horizon
+    size_t batchSize = 4096; // Rays per work item
+    int simdWidth = 0;       // Kernel width, one of CARTESIAN_WIDTHS
+    unsigned threads = 1;    // 0 uses the hardware concurrency
+
+    bool differentials = false; // Carry ray differentials (CartesianState::Magnification); set before Add
+    Spacetime spacetime = Spacetime::Schwarzschild; // Metric every stored ray follows; set before Add
+
+    int sortEvery = 8;      // Frames between fragmentation checks (0 never sorts)
+    size_t minRun = 64;     // Average run length below which a batch is re-sorted
+
+    bool mixedPrecision = true;   // false runs every ray in double
+    double promoteRadius = 3.0;   // r_s
+    double criticalBand = 0.1;    // Relative distance of b² from b_crit²
+    double driftTolerance = 1e-3; // Relative energy drift
+    bool demote = false;
+    double demoteRadius = 6.0;    // r_s
+
+    RayBatch<float> single;
+    RayBatch<double> precise;
+
+    RayProfile *profile = nullptr; // Per-ray cost attribution, if set
+
+    long frame = 0;
+    size_t runs = 0;                        // Runs of equal level stepped during the last frame
+    size_t singleRuns = 0, preciseRuns = 0; // The same per batch
+
+    size_t Size() const { return single.Size() + precise.Size(); }
+
+    // Drops every ray, keeping the settings.
+    void Clear()
+    {
+        single = RayBatch<float>{};
+        precise = RayBatch<double>{};
+        frame = 0;
+        runs = singleRuns = preciseRuns = 0;
+    }
+
+    void Add(LightRay &ray, int id, double r_s)
+    {
+        ray.kernel = RayKernel::Cartesian;
+        double scale = 1.0 / (VIS_SCALE * r_s);
+        CartesianState &s = ray.cartesian;
+        s.spacetime = spacetime;
+        s.Init(ray.pos.x * scale, ray.pos.y * scale, ray.dir.x, ray.dir.y);
+        s.differentials = differentials;
+        single.differentials = precise.differentials = differentials;
+        if (NeedsDouble(s))
+            precise.Push(s, id, maxLevel);
+        else
+            single.Push(s, id, maxLevel);
+    }
+
+    // b is conserved, so nearness to b_crit is settled at launch; radius and
+    // drift are checked as the ray moves.
+    bool NeedsDouble(const CartesianState &s) const
+    {
+        if (!mixedPrecision || std::abs(s.CriticalRatio() - 1.0) < criticalBand)
+            return true;
+        return Drifting(s, s.Radius());
+    }
+
+    bool Drifting(const CartesianState &s, double r) const
+    {
+        if (r < promoteRadius)
+            return true;
+        return std::abs(s.Energy() - s.e0) > driftTolerance * std::abs(s.e0);
+    }
+
+    double Horizon() const
+    {
+        return WithSpacetime(spacetime, [](auto metric) { return decltype(metric)::HORIZON; });
+    }
+
+    // Level for a ray at radius r (in r_s) and a frame of length dt.
+    int Level(double r, double dt, double r_s) const
+    {
+        double scale = r - Horizon();
+        if (scale <= 0.0)
+            return maxLevel;
+        double steps = c * dt / (r_s * accuracy * scale);
+        int level = steps > 1.0 ? static_cast<int>(std::ceil(std::log2(steps))) : 0;
+        return std::clamp(level, 0, maxLevel);
+    }
+
+    // Advances all stored rays by one frame of length dt (seconds).
+    void Update(std::vector<LightRay> &rays, double dt, double r_s)
+    {
+        if (sortEvery > 0 && frame % sortEvery == 0)
+        {
+            if (singleRuns * minRun > single.Size())
+                Sort(single, rays);
+            if (preciseRuns * minRun > precise.Size())
+                Sort(precise, rays);
+        }
+        ++frame;
+
+        if (profile)
+            profile->Track(rays);
+        singleRuns = StepRuns(single, dt, r_s);
+        preciseRuns = StepRuns(precise, dt, r_s);
+        runs = singleRuns + preciseRuns;
+
+        // Both batches are written back before any ray changes batch, so a
+        // ray that moves is synced exactly once this frame
+        RayBatch<double> promoted;
+        RayBatch<float> demoted;
+        promoted.differentials = demoted.differentials = differentials;
+        Sync(single, rays, dt, r_s, [&](const CartesianState &s, double r, int id, int level)
+             {
+                 if (!Drifting(s, r))
+                     return false;
+                 promoted.Push(s, id, level);
+                 return true;
+             });
+        Sync(precise, rays, dt, r_s, [&](const CartesianState &s, double r, int id, int level)
+             {
+                 if (!demote || r < demoteRadius || Drifting(s, r) || std::abs(s.CriticalRatio() - 1.0) < criticalBand)
+                     return false;
+                 demoted.Push(s, id, level);
+                 return true;
+             });
+        Append(precise, promoted);
+        Append(single, demoted);
+    }
+
+    // Moves every entry of `from` to the end of `to`, converting precision.
+    template <typename To, typename From>
+    static void Append(RayBatch<To> &to, const RayBatch<From> &from)
+    {
+        CartesianState s;
+        s.differentials = from.differentials;
+        for (size_t i = 0; i < from.Size(); ++i)
+        {
+            from.Load(i, s);
+            to.Push(s, from.ray[i], from.level[i]);
+        }
+    }
+
+    // Steps each run of equal level with its own step size. Returns the
+    // number of runs.
+    template <typename Real>
+    size_t StepRuns(RayBatch<Real> &batch, double dt, double r_s)
+    {
+        size_t count = 0;
+        for (size_t begin = 0; begin < batch.Size();)
+        {
+            int level = batch.level[begin];
+            size_t end = begin + 1;
+            while (end < batch.Size() && batch.level[end] == level)
+                ++end;
+
+            int steps = 1 << level;
+            Real h = static_cast<Real>(c * dt / (r_s * steps));
+            auto start = profile ? RayProfile::Clock::now() : RayProfile::Clock::time_point{};
+            size_t chunk = std::max<size_t>(batchSize, 1);
+            size_t chunks = (end - begin + chunk - 1) / chunk;
+            WithSpacetime(spacetime,
+                          [&](auto metric)
+                          {
+                              ParallelFor(
+                                  chunks,
+                                  [&](size_t j)
+                                  {
+                                      size_t from = begin + j * chunk;
+                                      size_t to = std::min(from + chunk, end);
+                                      for (int i = 0; i < steps; ++i)
+                                          batch.template Step<decltype(metric)>(h, from, to, simdWidth);
+                                  },
+                                  threads);
+                          });
+
+            if (profile)
+            {
+                double seconds = std::chrono::duration<double>(RayProfile::Clock::now() - start).count();
+                profile->Share(batch.ray.data() + begin, end - begin, seconds);
+                for (size_t i = begin; i < end; ++i)
+                    profile->Step(batch.ray[i], steps);
+            }
+
+            ++count;
+            begin = end;
+        }
+        return count;
+    }
+
+    // Orders a batch by outcome, level and radius band.
+    template <typename Real>
+    void Sort(RayBatch<Real> &batch, const std::vector<LightRay> &rays) const
+    {
+        const int bands = 16;
+        const int levels = maxLevel + 1;
+        std::vector<int> keys(batch.Size());
+        std::vector<size_t> start(2 * levels * bands + 1, 0);
+        for (size_t i = 0; i < batch.Size(); ++i)
+        {
+            double r = std::sqrt(double(batch.x[i]) * batch.x[i] + double(batch.y[i]) * batch.y[i]);
+            int band = std::clamp(static_cast<int>(std::log2(r)), 0, bands - 1);
+            int state = rays[batch.ray[i]].outcome == RayOutcome::Active ? 0 : 1;
+            keys[i] = (state * levels + batch.level[i]) * bands + band;
+            ++start[keys[i] + 1];
+        }
+        for (size_t key = 1; key < start.size(); ++key)
+            start[key] += start[key - 1];
+
+        std::vector<size_t> order(batch.Size());
+        for (size_t i = 0; i < batch.Size(); ++i)
+            order[start[keys[i]]++] = i;
+        batch.Permute(order);
+    }
+
+    // Writes a batch back to its LightRays and picks each ray's next level,
+    // dropping captured rays and those `move` hands to the other batch. The
+    // rest keep their order, so a sorted batch stays sorted.
+    template <typename Real, typename Move>
+    void Sync(RayBatch<Real> &batch, std::vector<LightRay> &rays, double dt, double r_s, Move &&move) const
+    {
+        double horizon = Horizon();
+        double photonSphere = WithSpacetime(spacetime, [](auto metric) { return decltype(metric)::PHOTON_SPHERE; });
+        size_t kept = 0;
+        for (size_t i = 0; i < batch.Size(); ++i)
+        {
+            LightRay &ray = rays[batch.ray[i]];
+            ray.step.t0 = ray.time;
+            ray.step.x0 = ray.pos.x;
+            ray.step.y0 = ray.pos.y;
+            ray.step.vx0 = ray.velocity.x * VIS_SCALE;
+            ray.step.vy0 = ray.velocity.y * VIS_SCALE;
+
+            batch.Load(i, ray.cartesian);
+            ray.SyncCartesian(r_s);
+            ray.time += dt;
+            ray.step.t1 = ray.time;
+            ray.step.x1 = ray.pos.x;
+            ray.step.y1 = ray.pos.y;
+            ray.step.vx1 = ray.velocity.x * VIS_SCALE;
+            ray.step.vy1 = ray.velocity.y * VIS_SCALE;
+            ray.RecordStep();
+
+            // Nothing turns an outbound ray outside the photon sphere
+            const CartesianState &s = ray.cartesian;
+            double r = s.Radius();
+            if (ray.outcome == RayOutcome::Active && r > photonSphere && s.x * s.vx + s.y * s.vy > 0.0)
+                ray.outcome = RayOutcome::Escaped;
+
+            int level = Level(r, dt, r_s);
+            batch.level[i] = level;
+
+            if (r < horizon)
+                ray.outcome = RayOutcome::Captured;
+            if (r < horizon || move(s, r, batch.ray[i], level))
+                continue;
+            if (kept != i)
+                batch.Move(i, kept);
+            ++kept;
+        }
+        batch.Truncate(kept);
+    }
+};
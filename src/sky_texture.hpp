@@ -0,0 +1,434 @@
+#pragma once
+
+#include "raylib.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#ifndef NOMINMAX
+#define NOMINMAX // Keeps min and max macros from breaking std::min and std::max
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Equirectangular sky in a preprocessed file that is used in place.
+//
+// Decoding a 16k x 8k PNG takes seconds and the decoded image hundreds of MB
+// before the first frame. Convert() does that once, offline: it builds the
+// mip chain and writes every level as square RGBA8 tiles, each tile's texels
+// contiguous. Open() then only maps the file, so startup costs a page fault
+// for the header, and the tiles that sampling actually touches -- coarse
+// levels for most of a small view, fine tiles where the lens magnifies --
+// are the only ones paged in.
+//
+// Layout: a SkyHeader, then level 0's tiles row by row, then level 1's, and
+// so on. Edge tiles are padded to full size.
+struct SkyHeader
+{
+    char magic[8];
+    uint32_t width, height;
+    uint32_t tileSize;
+    uint32_t levels;
+    uint64_t offsets[24]; // Byte offset of each level's first tile
+};
+
+struct SkyTexture
+{
+    static constexpr char MAGIC[8] = {'B', 'H', 'S', 'K', 'Y', '1', 0, 0};
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    const SkyHeader *header = nullptr;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+    int file = -1;
+#endif
+
+    SkyTexture() = default;
+    SkyTexture(const SkyTexture &) = delete;
+    SkyTexture &operator=(const SkyTexture &) = delete;
+    ~SkyTexture() { Close(); }
+
+    bool IsOpen() const { return header != nullptr; }
+
+    int Levels() const { return static_cast<int>(header->levels); }
+    int Width(int level) const { return std::max(1, static_cast<int>(header->width >> level)); }
+    int Height(int level) const { return std::max(1, static_cast<int>(header->height >> level)); }
+
+    // Maps a converted file. Returns false if it is missing, not a sky file,
+    // or its header describes tiles that run past the end of the file.
+    bool Open(const std::string &path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER length;
+        if (GetFileSizeEx(file, &length))
+            size = static_cast<size_t>(length.QuadPart);
+        if (size >= sizeof(SkyHeader))
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+            data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat info;
+        if (fstat(file, &info) == 0)
+            size = static_cast<size_t>(info.st_size);
+        if (size >= sizeof(SkyHeader))
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapped != MAP_FAILED)
+            {
+                data = static_cast<const uint8_t *>(mapped);
+                madvise(mapped, size, MADV_RANDOM); // No read-ahead: tiles are touched sparsely
+            }
+        }
+#endif
+        if (!data || size < sizeof(SkyHeader) || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+            !Fits(*reinterpret_cast<const SkyHeader *>(data), size))
+        {
+            Close();
+            return false;
+        }
+        header = reinterpret_cast<const SkyHeader *>(data);
+        return true;
+    }
+
+    // Whether every level the header lists lies inside a file of `size`
+    // bytes, so no texel lookup can read past the mapping.
+    static bool Fits(const SkyHeader &h, size_t size)
+    {
+        const uint32_t maxLevels = sizeof(h.offsets) / sizeof(h.offsets[0]);
+        if (h.width == 0 || h.height == 0 || h.width > (1u << 30) || h.height > (1u << 30))
+            return false;
+        if (h.tileSize == 0 || h.tileSize > (1u << 15) || h.levels == 0 || h.levels > maxLevels)
+            return false;
+
+        for (uint32_t level = 0; level < h.levels; ++level)
+        {
+            uint64_t levelW = std::max(1u, h.width >> level), levelH = std::max(1u, h.height >> level);
+            uint64_t tiles = ((levelW + h.tileSize - 1) / h.tileSize) * ((levelH + h.tileSize - 1) / h.tileSize);
+            uint64_t bytes = tiles * h.tileSize * h.tileSize * 4;
+            if (h.offsets[level] < sizeof(SkyHeader) || h.offsets[level] > size || bytes > size - h.offsets[level])
+                return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data)
+            munmap(const_cast<uint8_t *>(data), size);
+        if (file >= 0)
+            close(file);
+        file = -1;
+#endif
+        data = nullptr;
+        header = nullptr;
+        size = 0;
+    }
+
+    // Texel (x, y) of a level, wrapping in longitude and clamping in latitude.
+    const uint8_t *Texel(int level, int x, int y) const
+    {
+        int w = Width(level), h = Height(level);
+        x %= w;
+        if (x < 0)
+            x += w;
+        y = std::clamp(y, 0, h - 1);
+
+        uint32_t t = header->tileSize;
+        uint32_t tilesX = (w + t - 1) / t;
+        uint64_t tile = (y / t) * tilesX + x / t;
+        uint64_t offset = header->offsets[level] + (tile * t * t + (y % t) * t + x % t) * 4;
+        return data + offset;
+    }
+
+    // Bilinear lookup at texel coordinates (u, v) of a level, in linear RGB.
+    Vector3 Bilinear(int level, float u, float v) const
+    {
+        u -= 0.5f;
+        v -= 0.5f;
+        int x = static_cast<int>(std::floor(u)), y = static_cast<int>(std::floor(v));
+        float fx = u - x, fy = v - y;
+
+        Vector3 sum{0, 0, 0};
+        for (int j = 0; j < 2; ++j)
+            for (int i = 0; i < 2; ++i)
+            {
+                float weight = (i ? fx : 1.0f - fx) * (j ? fy : 1.0f - fy);
+                const uint8_t *texel = Texel(level, x + i, y + j);
+                sum.x += weight * Linear(texel[0]);
+                sum.y += weight * Linear(texel[1]);
+                sum.z += weight * Linear(texel[2]);
+            }
+        return sum;
+    }
+
+    // Colour of the sky in unit direction dir (z up) at a mip level.
+    Vector3 Sample(Vector3 dir, int level = 0) const
+    {
+        level = std::clamp(level, 0, Levels() - 1);
+        float u = (std::atan2(dir.y, dir.x) / (2.0f * PI) + 0.5f) * Width(level);
+        float v = std::acos(std::clamp(dir.z, -1.0f, 1.0f)) / PI * Height(level);
+        return Bilinear(level, u, v);
+    }
+
+    // A pixel's footprint on the sky: its centre (u, v) and the two axes it
+    // spans, one pixel step across and one down, all in level-0 texels.
+    struct Footprint
+    {
+        float u, v;
+        float ax, ay, bx, by;
+    };
+
+    static constexpr int MAX_ANISO = 16;
+
+    // Footprint of the pixel looking at unit direction dir, given how dir
+    // changes per pixel across (dx) and down (dy).
+    Footprint Project(Vector3 dir, Vector3 dx, Vector3 dy) const
+    {
+        float w = static_cast<float>(header->width), h = static_cast<float>(header->height);
+        float ring2 = std::max(dir.x * dir.x + dir.y * dir.y, 1e-8f);
+        float ring = std::sqrt(ring2);
+        auto du = [&](Vector3 d) { return (dir.x * d.y - dir.y * d.x) / ring2 * w / (2.0f * PI); };
+        auto dv = [&](Vector3 d) { return -d.z / ring * h / PI; };
+        return Footprint{(std::atan2(dir.y, dir.x) / (2.0f * PI) + 0.5f) * w,
+                         std::acos(std::clamp(dir.z, -1.0f, 1.0f)) / PI * h,
+                         du(dx),
+                         dv(dx),
+                         du(dy),
+                         dv(dy)};
+    }
+
+    // Anisotropic filtering of many footprints at once, the way a GPU
+    // sampler does it: the mip level follows the footprint's minor axis (but
+    // is raised until the major axis needs no more than maxAniso taps), and
+    // bilinear taps at that level are spread along the major axis. Lanes are
+    // laid out as arrays so the level selection, tap placement and bilinear
+    // weights vectorize; only the texel fetches are scalar.
+    void SampleFootprints(const Footprint *in, Vector3 *out, size_t n, int maxAniso = 8) const
+    {
+        constexpr size_t LANES = 16;
+        maxAniso = std::clamp(maxAniso, 1, MAX_ANISO);
+        const int top = Levels() - 1;
+
+        for (size_t base = 0; base < n; base += LANES)
+        {
+            size_t lanes = std::min(LANES, n - base);
+            const Footprint *f = in + base;
+
+            // Level and tap layout per lane
+            float scale[LANES], stepU[LANES], stepV[LANES], startU[LANES], startV[LANES];
+            int level[LANES], taps[LANES];
+            for (size_t l = 0; l < lanes; ++l)
+            {
+                float a2 = f[l].ax * f[l].ax + f[l].ay * f[l].ay, b2 = f[l].bx * f[l].bx + f[l].by * f[l].by;
+                bool aMajor = a2 >= b2;
+                float major = std::sqrt(aMajor ? a2 : b2), minor = std::sqrt(aMajor ? b2 : a2);
+                float mu = aMajor ? f[l].ax : f[l].bx, mv = aMajor ? f[l].ay : f[l].by;
+
+                float width = std::max({minor, major / maxAniso, 1.0f});
+                level[l] = std::min(top, static_cast<int>(std::lround(std::log2(width))));
+                scale[l] = 1.0f / static_cast<float>(1 << level[l]);
+                taps[l] = std::clamp(static_cast<int>(std::ceil(major * scale[l])), 1, maxAniso);
+                stepU[l] = mu / taps[l];
+                stepV[l] = mv / taps[l];
+                startU[l] = f[l].u - 0.5f * mu + 0.5f * stepU[l];
+                startV[l] = f[l].v - 0.5f * mv + 0.5f * stepV[l];
+            }
+
+            // Taps as one flat list
+            float tu[LANES * MAX_ANISO], tv[LANES * MAX_ANISO], tw[LANES * MAX_ANISO];
+            int owner[LANES * MAX_ANISO];
+            size_t count = 0;
+            for (size_t l = 0; l < lanes; ++l)
+                for (int t = 0; t < taps[l]; ++t)
+                {
+                    tu[count] = (startU[l] + t * stepU[l]) * scale[l] - 0.5f;
+                    tv[count] = (startV[l] + t * stepV[l]) * scale[l] - 0.5f;
+                    tw[count] = 1.0f / taps[l];
+                    owner[count++] = static_cast<int>(l);
+                }
+
+            int tx[LANES * MAX_ANISO], ty[LANES * MAX_ANISO];
+            float fx[LANES * MAX_ANISO], fy[LANES * MAX_ANISO];
+            for (size_t t = 0; t < count; ++t)
+            {
+                float x = std::floor(tu[t]), y = std::floor(tv[t]);
+                fx[t] = tu[t] - x;
+                fy[t] = tv[t] - y;
+                tx[t] = static_cast<int>(x);
+                ty[t] = static_cast<int>(y);
+            }
+
+            Vector3 sum[LANES] = {};
+            for (size_t t = 0; t < count; ++t)
+            {
+                int lvl = level[owner[t]];
+                const uint8_t *c00 = Texel(lvl, tx[t], ty[t]), *c10 = Texel(lvl, tx[t] + 1, ty[t]);
+                const uint8_t *c01 = Texel(lvl, tx[t], ty[t] + 1), *c11 = Texel(lvl, tx[t] + 1, ty[t] + 1);
+                float w00 = (1 - fx[t]) * (1 - fy[t]) * tw[t], w10 = fx[t] * (1 - fy[t]) * tw[t];
+                float w01 = (1 - fx[t]) * fy[t] * tw[t], w11 = fx[t] * fy[t] * tw[t];
+                Vector3 &acc = sum[owner[t]];
+                acc.x += w00 * Linear(c00[0]) + w10 * Linear(c10[0]) + w01 * Linear(c01[0]) + w11 * Linear(c11[0]);
+                acc.y += w00 * Linear(c00[1]) + w10 * Linear(c10[1]) + w01 * Linear(c01[1]) + w11 * Linear(c11[1]);
+                acc.z += w00 * Linear(c00[2]) + w10 * Linear(c10[2]) + w01 * Linear(c01[2]) + w11 * Linear(c11[2]);
+            }
+            std::copy(sum, sum + lanes, out + base);
+        }
+    }
+
+    static float Linear(uint8_t value)
+    {
+        static const std::vector<float> table = []()
+        {
+            std::vector<float> t(256);
+            for (int i = 0; i < 256; ++i)
+                t[i] = std::pow(i / 255.0f, 2.2f);
+            return t;
+        }();
+        return table[value];
+    }
+
+    // Converts an equirectangular image into a tiled, mipmapped sky file.
+    static bool Convert(const std::string &imagePath, const std::string &outPath, uint32_t tileSize = 128)
+    {
+        Image image = LoadImage(imagePath.c_str());
+        if (!IsImageValid(image))
+            return false;
+        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        bool converted = Convert(image, outPath, tileSize);
+        UnloadImage(image);
+        return converted;
+    }
+
+    // The same from an image already in memory, which must be RGBA8.
+    static bool Convert(const Image &image, const std::string &outPath, uint32_t tileSize = 128)
+    {
+        if (image.data == nullptr || image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 || image.width <= 0 ||
+            image.height <= 0 || tileSize == 0)
+            return false;
+
+        SkyHeader header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.width = image.width;
+        header.height = image.height;
+        header.tileSize = tileSize;
+
+        std::FILE *out = std::fopen(outPath.c_str(), "wb");
+        if (!out)
+            return false;
+        std::vector<uint8_t> level(static_cast<const uint8_t *>(image.data),
+                                   static_cast<const uint8_t *>(image.data) + size_t(image.width) * image.height * 4);
+
+        // A short write (a full disk, say) would leave a truncated file
+        // behind; remove it instead
+        auto fail = [&]()
+        {
+            std::fclose(out);
+            std::remove(outPath.c_str());
+            return false;
+        };
+        if (std::fwrite(&header, sizeof(header), 1, out) != 1) // Placeholder until the offsets are known
+            return fail();
+
+        int w = header.width, h = header.height;
+        uint64_t offset = sizeof(header);
+        const uint32_t maxLevels = sizeof(header.offsets) / sizeof(header.offsets[0]);
+        std::vector<uint8_t> tile(size_t(tileSize) * tileSize * 4);
+        for (header.levels = 0; header.levels < maxLevels; ++header.levels)
+        {
+            header.offsets[header.levels] = offset;
+            uint32_t tilesX = (w + tileSize - 1) / tileSize, tilesY = (h + tileSize - 1) / tileSize;
+            for (uint32_t ty = 0; ty < tilesY; ++ty)
+                for (uint32_t tx = 0; tx < tilesX; ++tx)
+                {
+                    for (uint32_t y = 0; y < tileSize; ++y)
+                        for (uint32_t x = 0; x < tileSize; ++x)
+                        {
+                            int sx = std::min<int>(tx * tileSize + x, w - 1);
+                            int sy = std::min<int>(ty * tileSize + y, h - 1);
+                            std::memcpy(&tile[(y * tileSize + x) * 4], &level[(size_t(sy) * w + sx) * 4], 4);
+                        }
+                    if (std::fwrite(tile.data(), 1, tile.size(), out) != tile.size())
+                        return fail();
+                    offset += tile.size();
+                }
+
+            if (w == 1 && h == 1)
+            {
+                ++header.levels;
+                break;
+            }
+            level = Downsample(level, w, h);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+
+        if (std::fseek(out, 0, SEEK_SET) != 0 || std::fwrite(&header, sizeof(header), 1, out) != 1)
+            return fail();
+        if (std::fclose(out) != 0)
+        {
+            std::remove(outPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // 2x2 box filter, averaging in linear light.
+    static std::vector<uint8_t> Downsample(const std::vector<uint8_t> &src, int w, int h)
+    {
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        std::vector<uint8_t> dst(size_t(nw) * nh * 4);
+        for (int y = 0; y < nh; ++y)
+            for (int x = 0; x < nw; ++x)
+                for (int c = 0; c < 4; ++c)
+                {
+                    float sum = 0.0f;
+                    for (int j = 0; j < 2; ++j)
+                        for (int i = 0; i < 2; ++i)
+                        {
+                            int sx = std::min(2 * x + i, w - 1), sy = std::min(2 * y + j, h - 1);
+                            uint8_t value = src[(size_t(sy) * w + sx) * 4 + c];
+                            sum += c < 3 ? Linear(value) : value / 255.0f;
+                        }
+                    float mean = 0.25f * sum;
+                    if (c < 3)
+                        mean = std::pow(mean, 1.0f / 2.2f);
+                    dst[(size_t(y) * nw + x) * 4 + c] = static_cast<uint8_t>(std::lround(255.0f * mean));
+                }
+        return dst;
+    }
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include "cartesian_kernel.hpp"
+#include "counter_rng.hpp"
+#include "lensing_renderer.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A point source at infinity.
+struct Star
+{
+    Vector3 dir;   // Unit direction of the star as seen from the hole (z up)
+    Vector3 flux;  // Linear RGB, deposited into the frame per unlensed image
+};
+
+// Where the photons from a distant star reach a camera at `distance`, for
+// every launch angle at once.
+//
+// A ray leaving the camera at angle alpha from the direction of the hole
+// stays in one plane and escapes at polar angle Psi(alpha) in that plane,
+// unwrapped so that each winding adds 2 pi. Psi falls monotonically from
+// infinity at the edge of the shadow (alpha_shadow) to 0 for a ray sent
+// straight away from the hole. The table samples Psi at log-spaced
+// alpha - alpha_shadow, where the windings grow linearly, so images of every
+// order come out of one search and an interpolation.
+struct DeflectionTable
+{
+    double distance = 0.0;
+    double alphaShadow = 0.0;
+    std::vector<double> u;   // log(alpha - alphaShadow), increasing
+    std::vector<double> psi; // Escape angle at each u, decreasing
+
+    int samples = 4096;
+    double accuracy = 0.005; // Step as a fraction of the distance to the horizon
+    double farRadius = 400.0;
+
+    void Build(double cameraDistance, unsigned threads = 0)
+    {
+        distance = cameraDistance;
+
+        // The shadow edge, by bisection on the outcome
+        double lo = 0.0, hi = 0.5 * PI;
+        for (int i = 0; i < 60; ++i)
+        {
+            double mid = 0.5 * (lo + hi);
+            (std::isnan(Trace(mid)) ? lo : hi) = mid;
+        }
+        alphaShadow = hi;
+
+        double u0 = std::log(1e-9), u1 = std::log(PI - alphaShadow);
+        u.resize(samples);
+        psi.resize(samples);
+        ParallelFor(
+            samples,
+            [&](size_t i)
+            {
+                u[i] = u0 + (u1 - u0) * i / (samples - 1);
+                psi[i] = Trace(alphaShadow + std::exp(u[i]));
+            },
+            threads, 16);
+    }
+
+    // Unwrapped escape angle of the ray launched at alpha, NaN if captured.
+    double Trace(double alpha) const
+    {
+        CartesianState s;
+        s.Init(distance, 0.0, -std::cos(alpha), std::sin(alpha));
+        double angle = PI - alpha;
+        for (int i = 0; i < 10000000; ++i)
+        {
+            double r = s.Radius();
+            bool outbound = s.x * s.vx + s.y * s.vy > 0.0;
+            if (r < 1.0 || (r < 1.5 && !outbound))
+                return NAN;
+            if (r > farRadius && outbound)
+                return angle;
+
+            double vx = s.vx, vy = s.vy;
+            s.Step(std::clamp(accuracy * (r - 1.0), 1e-5, 8.0));
+            angle += std::atan2(vx * s.vy - vy * s.vx, vx * s.vx + vy * s.vy);
+        }
+        return NAN;
+    }
+
+    // Launch angle whose ray escapes at unwrapped angle target, and dPsi/dalpha
+    // there. Returns false if the table does not reach that many windings.
+    bool Solve(double target, double &alpha, double &slope) const
+    {
+        if (psi.empty() || target > psi.front() || target < psi.back())
+            return false;
+
+        // psi is decreasing
+        size_t hi = std::lower_bound(psi.begin(), psi.end(), target, std::greater<double>()) - psi.begin();
+        size_t lo = hi == 0 ? 0 : hi - 1;
+        hi = std::max(hi, lo + 1);
+        double t = (psi[lo] - target) / (psi[lo] - psi[hi]);
+        double logOffset = u[lo] + t * (u[hi] - u[lo]);
+        alpha = alphaShadow + std::exp(logOffset);
+        slope = (psi[hi] - psi[lo]) / (u[hi] - u[lo]) / std::exp(logOffset);
+        return true;
+    }
+};
+
+// Forward lensing of a star catalog.
+//
+// Tracing every pixel to find a few thousand point sources wastes nearly all
+// of the rays. Here each star instead gets its images from the lens equation:
+// in the plane through the camera, the hole and the star, an image of order n
+// is a launch angle whose escape angle matches the star's angle theta from
+// the camera axis after n half-windings (Psi = theta + 2 pi m on one side of
+// the hole, Psi = 2 pi - theta + 2 pi m on the other). Its magnification is
+// the ratio of solid angles, sin(alpha) / (|sin Psi| |dPsi/dalpha|). The
+// images are splatted into the frame, so the cost scales with the number of
+// stars times the number of image orders, not with the pixel count.
+struct StarLensing
+{
+    std::vector<Star> catalog;
+    DeflectionTable table;
+    int maxOrder = 2;               // 0 keeps primary images only
+    float maxMagnification = 100.0f; // Clamp near the Einstein ring
+    unsigned threads = 0;
+    float rotation = 0.0f;           // Turn of the whole catalog about the disk's axis (radians)
+
+    struct StarImage
+    {
+        Vector3 dir; // From the camera
+        float magnification;
+        int star;
+    };
+
+    // Random stars, uniform over the sky, with a power-law brightness
+    // distribution and a range of tints.
+    static std::vector<Star> RandomCatalog(size_t count, uint64_t seed = 1)
+    {
+        CounterRng rng{seed};
+        std::vector<Star> stars(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto r = rng.Uniform(i, 0);
+            float z = 2.0f * r[0] - 1.0f, phi = 2.0f * PI * r[1];
+            float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+            float brightness = 0.05f * std::pow(1.0f - r[2], -1.5f);
+            float tint = r[3];
+            stars[i].dir = Vector3{ring * std::cos(phi), ring * std::sin(phi), z};
+            stars[i].flux = Vector3{brightness * (0.8f + 0.4f * tint), brightness, brightness * (1.2f - 0.4f * tint)};
+        }
+        return stars;
+    }
+
+    // Image directions and magnifications of every star, as seen by camera.
+    std::vector<StarImage> Images(const LensCamera &camera)
+    {
+        if (table.distance != camera.distance)
+            table.Build(camera.distance, threads);
+
+        Vector3 e1 = Vector3Normalize(camera.Position());
+        float c = std::cos(rotation), s = std::sin(rotation);
+        std::vector<std::vector<StarImage>> perStar(catalog.size());
+        ParallelFor(
+            catalog.size(),
+            [&](size_t i)
+            {
+                Vector3 d = catalog[i].dir;
+                Vector3 dir{c * d.x - s * d.y, s * d.x + c * d.y, d.z};
+                float cosTheta = std::clamp(Vector3DotProduct(dir, e1), -1.0f, 1.0f);
+                double theta = std::acos(cosTheta);
+                Vector3 e2 = Vector3Subtract(dir, Vector3Scale(e1, cosTheta));
+                if (Vector3Length(e2) < 1e-6f)
+                    e2 = std::abs(e1.z) < 0.9f ? Vector3{0, 0, 1} : Vector3{1, 0, 0};
+                e2 = Vector3Normalize(Vector3Subtract(e2, Vector3Scale(e1, Vector3DotProduct(e2, e1))));
+
+                for (int order = 0; order <= maxOrder; ++order)
+                {
+                    int windings = order / 2;
+                    bool opposite = order % 2 == 1; // Passes the hole on the side away from the star
+                    double target = (opposite ? 2.0 * PI - theta : theta) + 2.0 * PI * windings;
+
+                    double alpha, slope;
+                    if (!table.Solve(target, alpha, slope))
+                        continue;
+
+                    float side = opposite ? -1.0f : 1.0f;
+                    Vector3 dir = Vector3Add(Vector3Scale(e1, static_cast<float>(-std::cos(alpha))),
+                                             Vector3Scale(e2, side * static_cast<float>(std::sin(alpha))));
+                    double area = std::abs(std::sin(target)) * std::abs(slope);
+                    float mu = area > 0.0 ? static_cast<float>(std::sin(alpha) / area) : maxMagnification;
+                    perStar[i].push_back(StarImage{dir, std::min(mu, maxMagnification), static_cast<int>(i)});
+                }
+            },
+            threads, 256);
+
+        std::vector<StarImage> images;
+        for (auto &list : perStar)
+            images.insert(images.end(), list.begin(), list.end());
+        return images;
+    }
+
+    // Adds every image to the frame, split bilinearly over the four nearest
+    // pixels. With a lens map from the backward pass, images that land on
+    // the disk or the shadow are hidden.
+    void Splat(const LensCamera &camera, Framebuffer &frame, const std::vector<LensSample> *occlusion = nullptr)
+    {
+        for (const StarImage &image : Images(camera))
+        {
+            float px, py;
+            if (!camera.Project(image.dir, px, py))
+                continue;
+
+            int x0 = static_cast<int>(std::floor(px)), y0 = static_cast<int>(std::floor(py));
+            float fx = px - x0, fy = py - y0;
+            const Star &star = catalog[image.star];
+            for (int j = 0; j < 2; ++j)
+                for (int i = 0; i < 2; ++i)
+                {
+                    int x = x0 + i, y = y0 + j;
+                    if (x < 0 || y < 0 || x >= frame.width || y >= frame.height)
+                        continue;
+                    size_t pixel = static_cast<size_t>(y) * frame.width + x;
+                    if (occlusion && (*occlusion)[pixel].outcome != PixelOutcome::Sky)
+                        continue;
+
+                    float weight = (i ? fx : 1.0f - fx) * (j ? fy : 1.0f - fy) * image.magnification;
+                    frame.rgb[3 * pixel] += weight * star.flux.x;
+                    frame.rgb[3 * pixel + 1] += weight * star.flux.y;
+                    frame.rgb[3 * pixel + 2] += weight * star.flux.z;
+                }
+        }
+    }
+};
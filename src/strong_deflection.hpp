@@ -0,0 +1,157 @@
+#pragma once
+
+#include "effective_potential.hpp"
+
+#include <cmath>
+
+// Analytic leg for a ray winding around the photon sphere.
+//
+// Writing the path as u(phi) = r_s/r, the invariant of EffectivePotential
+// gives u'² = e^u (I - V(u)). Around the peak u = 1/2 (r = 2 r_s) this
+// expands to w'² = delta + w², with w = u - 1/2 and delta = sqrt(e) (I - V_p),
+// so w'' = w and
+//
+//   w(phi) = A e^phi + B e^-phi,   -4AB = delta.
+//
+// A ray with impact parameter close to b_crit spends a winding angle of order
+// log(1/|delta|) inside a thin shell around the peak -- the logarithmic
+// divergence of the strong-deflection limit. Instead of integrating through
+// the shell, the leg takes delta from the exact invariant and w from the
+// ray's radius on entry, finds the angle at which |w| reaches the shell edge
+// again, and evaluates the closed form in between. (Deriving delta from the
+// local w' instead would be swamped by the O(w³) terms the expansion drops.)
+// The cost is the same for one winding or twenty; only the entry and exit
+// legs are left to the integrator.
+//
+// All lengths are in units of r_s.
+struct WindingLeg
+{
+    bool active = false;
+
+    double shell = 0.01;       // Half width of the shell in u
+    double minWinding = 1.0;   // Radians; shorter passes are left to the integrator
+    bool tried = false;        // Solved during the current pass through the shell
+
+    double A = 0.0, B = 0.0;   // Coefficients of w(phi)
+    double phi0 = 0.0;         // Polar angle on entry
+    double sign = 1.0;         // Direction of rotation
+    double s = 0.0, sEnd = 0.0; // Arc length travelled and at the exit
+
+    double W(double phi) const { return A * std::exp(phi) + B * std::exp(-phi); }
+    double WPrime(double phi) const { return A * std::exp(phi) - B * std::exp(-phi); }
+
+    // Arc length after winding by phi, using ds = r dphi with r = 1/(1/2 + w)
+    // to first order in w: s = 2 phi - 4 * integral of w.
+    double Arc(double phi) const
+    {
+        return 2.0 * phi - 4.0 * (A * (std::exp(phi) - 1.0) - B * (std::exp(-phi) - 1.0));
+    }
+
+    // Whether (x, y) lies inside the shell, the only test Solve needs no
+    // exp or sqrt of the direction for.
+    bool InShell(double x, double y) const { return std::abs(1.0 / std::sqrt(x * x + y * y) - 0.5) < shell; }
+
+    // Solves once per pass through the shell, the first time the ray is found
+    // inside it. The invariant is constant along the path, so a ray turned
+    // down on entry would be turned down on every later step of the pass.
+    void Enter(double x, double y, double dx, double dy)
+    {
+        if (!InShell(x, y))
+            tried = false;
+        else if (!tried)
+        {
+            *this = Solve(x, y, dx, dy, shell, minWinding);
+            tried = true;
+        }
+    }
+
+    // Starts a leg for a ray at (x, y) heading along unit (dx, dy). Returns an
+    // inactive leg if the ray is outside the shell or would not wind for long.
+    static WindingLeg Solve(double x, double y, double dx, double dy, double shellWidth = 0.01,
+                            double minimumWinding = 1.0)
+    {
+        WindingLeg leg;
+        leg.shell = shellWidth;
+        leg.minWinding = minimumWinding;
+
+        double r = std::sqrt(x * x + y * y);
+        double u = 1.0 / r;
+        double w = u - 0.5;
+        if (std::abs(w) >= leg.shell)
+            return leg;
+
+        double L = x * dy - y * dx; // r sin(psi), signed by the rotation
+        if (L == 0.0)
+            return leg;
+
+        // w' from the model's own first integral, with the sign of
+        // du/dphi = -u cot(psi), so that -4AB is exactly delta
+        const EffectivePotential potential(1.0);
+        double delta = std::exp(0.5) * (potential.Invariant(r, std::abs(L) / r) - potential.PeakPotential());
+        double slope2 = w * w + delta;
+        if (slope2 < 0.0)
+            return leg;
+        double wPrime = x * dx + y * dy > 0.0 ? -std::sqrt(slope2) : std::sqrt(slope2);
+
+        leg.A = 0.5 * (w + wPrime);
+        leg.B = 0.5 * (w - wPrime);
+        leg.sign = L > 0.0 ? 1.0 : -1.0;
+        leg.phi0 = std::atan2(y, x);
+
+        // Exit where |w| = shell on the growing branch (A e^phi dominates,
+        // so w leaves on the side of A's sign). With E = e^phi that is
+        // A E² - edge E + B = 0 for edge = shell * sign(A); take the later root.
+        if (leg.A == 0.0)
+            return leg;
+        double disc = leg.shell * leg.shell - 4.0 * leg.A * leg.B;
+        if (disc < 0.0)
+            return leg;
+        double E = (leg.shell + std::sqrt(disc)) / (2.0 * std::abs(leg.A));
+        if (E <= 1.0)
+            return leg;
+
+        double winding = std::log(E);
+        if (winding < leg.minWinding)
+            return leg;
+
+        leg.active = true;
+        leg.s = 0.0;
+        leg.sEnd = leg.Arc(winding);
+        return leg;
+    }
+
+    // Moves `distance` along the leg and returns what is left past its exit.
+    double Advance(double distance)
+    {
+        double remaining = 0.0;
+        s += distance;
+        if (s >= sEnd)
+        {
+            remaining = s - sEnd;
+            s = sEnd;
+            active = false;
+        }
+        return remaining;
+    }
+
+    // Current position and unit direction.
+    void Evaluate(double &x, double &y, double &dx, double &dy) const
+    {
+        // Invert Arc with a Newton step from the circular-orbit guess
+        double phi = 0.5 * s;
+        phi -= (Arc(phi) - s) / (2.0 - 4.0 * W(phi));
+
+        double u = 0.5 + W(phi);
+        double r = 1.0 / u;
+        double cotPsi = -WPrime(phi) / u;
+        double sinPsi = 1.0 / std::sqrt(1.0 + cotPsi * cotPsi);
+        double cosPsi = cotPsi * sinPsi;
+
+        double angle = phi0 + sign * phi;
+        double rx = std::cos(angle), ry = std::sin(angle);
+        x = r * rx;
+        y = r * ry;
+        dx = cosPsi * rx - sign * sinPsi * ry;
+        dy = cosPsi * ry + sign * sinPsi * rx;
+    }
+};
@@ -0,0 +1,260 @@
+#include "raylib.h"
+
+#include "counter_rng.hpp"
+#include "effective_potential.hpp"
+#include "generic_metric.hpp"
+#include "lensing_renderer.hpp"
+#include "light_ray.hpp"
+#include "physics.hpp"
+#include "sky_texture.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Deterministic checks of the numerical building blocks. Each prints one line
+// and the program fails if any of them does.
+
+static int failures = 0;
+
+static void Check(bool ok, const std::string &name, const std::string &detail)
+{
+    std::cout << (ok ? "ok    " : "FAIL  ") << name << ": " << detail << '\n';
+    failures += ok ? 0 : 1;
+}
+
+static std::string Format(const char *format, double value)
+{
+    char text[64];
+    std::snprintf(text, sizeof(text), format, value);
+    return text;
+}
+
+// Known-answer vectors of Philox4x32-10 from the Random123 distribution.
+static void PhiloxKnownAnswers()
+{
+    struct Vector
+    {
+        CounterRng::Block counter;
+        uint32_t key0, key1;
+        CounterRng::Block expected;
+    };
+    const Vector vectors[] = {
+        {{0, 0, 0, 0}, 0, 0, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, 0xffffffff, 0xffffffff,
+         {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, 0xa4093822, 0x299f31d0,
+         {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+    };
+    int matched = 0;
+    for (const Vector &v : vectors)
+        matched += CounterRng::Philox(v.counter, v.key0, v.key1) == v.expected ? 1 : 0;
+    Check(matched == 3, "Philox4x32-10 known answers", std::to_string(matched) + "/3 match");
+}
+
+// Invert4 on metric tensors, checked through |m * inv - I|.
+static void InverseOfMetrics()
+{
+    std::vector<MetricTensor<double>> metrics;
+
+    // Schwarzschild at r = 3, theta = 1 (units of M)
+    double r = 3.0, theta = 1.0, f = 1.0 - 2.0 / r;
+    metrics.push_back({{{-f, 0, 0, 0}, {0, 1.0 / f, 0, 0}, {0, 0, r * r, 0},
+                        {0, 0, 0, r * r * std::sin(theta) * std::sin(theta)}}});
+
+    // Kerr in Boyer-Lindquist coordinates at r = 4, theta = 0.8, a = 0.9
+    double a = 0.9;
+    r = 4.0;
+    theta = 0.8;
+    double s2 = std::sin(theta) * std::sin(theta), sigma = r * r + a * a * std::cos(theta) * std::cos(theta);
+    double delta = r * r - 2.0 * r + a * a;
+    double gtp = -2.0 * r * a * s2 / sigma;
+    metrics.push_back({{{-(1.0 - 2.0 * r / sigma), 0, 0, gtp},
+                        {0, sigma / delta, 0, 0},
+                        {0, 0, sigma, 0},
+                        {gtp, 0, 0, (r * r + a * a + 2.0 * r * a * a * s2 / sigma) * s2}}});
+
+    // Dense symmetric matrices with a dominant diagonal, from counter draws
+    for (uint32_t n = 0; n < 64; ++n)
+    {
+        MetricTensor<double> m{};
+        for (int i = 0; i < 4; ++i)
+        {
+            CounterRng::Block bits = CounterRng::Philox({n, uint32_t(i), 0, 0}, 7, 11);
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = bits[j] / 4294967296.0 - 0.5;
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < i; ++j)
+                m[i][j] = m[j][i];
+            m[i][i] += i == 0 ? -3.0 : 3.0;
+        }
+        metrics.push_back(m);
+    }
+
+    double worst = 0.0;
+    for (const MetricTensor<double> &m : metrics)
+    {
+        MetricTensor<double> inv{};
+        Invert4(m, inv);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+            {
+                double sum = 0.0;
+                for (int k = 0; k < 4; ++k)
+                    sum += m[i][k] * inv[k][j];
+                worst = std::max(worst, std::abs(sum - (i == j ? 1.0 : 0.0)));
+            }
+    }
+    Check(worst < 1e-12, "Invert4 of " + std::to_string(metrics.size()) + " metrics",
+          "worst |m inv - I| " + Format("%.2e", worst));
+}
+
+// The effective potential's invariant must hold along polar orbits to well
+// within its tolerance, or Classify could decide a ray on the wrong side.
+static void PotentialInvariant()
+{
+    const double r_s = BlackHole(Vector2{0, 0}, 8.54e36).r_s;
+    const double dt = 100.0 / 60.0; // One step per frame at the demo's time scale
+    EffectivePotential potential(r_s);
+    const double bCrit = potential.CriticalImpactParameter() * VIS_SCALE; // Pixels
+
+    double worst = 0.0;
+    int steps = 0;
+    for (double ratio : {0.9, 1.001, 1.05, 1.3})
+    {
+        LightRay ray(Vector2{-800.0f, static_cast<float>(ratio * bCrit)}, Vector2{1, 0});
+        ray.recordPath = false;
+
+        auto invariant = [&]()
+        {
+            double x = ray.pos.x / VIS_SCALE, y = ray.pos.y / VIS_SCALE;
+            double radius = std::sqrt(x * x + y * y);
+            return potential.Invariant(radius, std::abs(x * ray.dir.y - y * ray.dir.x) / radius);
+        };
+        double i0 = invariant();
+        for (int frame = 0; frame < 20000; ++frame)
+        {
+            ray.Advance(dt, r_s);
+            double radius = ray.r / r_s;
+            if (radius < 1.1 || radius > 15.0)
+                break;
+            worst = std::max(worst, std::abs(invariant() / i0 - 1.0));
+            ++steps;
+        }
+    }
+    Check(steps > 1000 && worst < potential.tolerance, "EffectivePotential invariant",
+          std::to_string(steps) + " steps, worst drift " + Format("%.2e", worst) + " against tolerance " + Format("%.0e", potential.tolerance));
+}
+
+// Octahedral directions must survive LensMap's 16-bit packing to about 3e-5 rad.
+static void LensMapRoundTrip()
+{
+    double worst = 0.0;
+    bool masked = false;
+    for (uint32_t n = 0; n < 100000; ++n)
+    {
+        CounterRng::Block bits = CounterRng::Philox({n, 0, 0, 0}, 3, 5);
+        double z = 2.0 * (bits[0] / 4294967296.0) - 1.0, phi = 2.0 * PI * (bits[1] / 4294967296.0);
+        double s = std::sqrt(std::max(0.0, 1.0 - z * z));
+        Vector3 dir{static_cast<float>(s * std::cos(phi)), static_cast<float>(s * std::sin(phi)), static_cast<float>(z)};
+
+        uint32_t texel = LensMap::Encode(dir);
+        masked |= texel == LensMap::MASKED;
+        Vector3 back = LensMap::Decode(texel);
+        double dot = double(dir.x) * back.x + double(dir.y) * back.y + double(dir.z) * back.z;
+        double cross = std::hypot(double(dir.y) * back.z - double(dir.z) * back.y,
+                                  double(dir.z) * back.x - double(dir.x) * back.z,
+                                  double(dir.x) * back.y - double(dir.y) * back.x);
+        worst = std::max(worst, std::atan2(cross, dot));
+    }
+    for (Vector3 axis : {Vector3{1, 0, 0}, Vector3{0, -1, 0}, Vector3{0, 0, 1}, Vector3{0, 0, -1}})
+        masked |= LensMap::Encode(axis) == LensMap::MASKED;
+    Check(worst < 1e-4 && !masked, "LensMap octahedral round trip",
+          "worst error " + Format("%.2e", worst) + " rad" + (masked ? ", a direction encoded to MASKED" : ""));
+}
+
+// A sky converted from an in-memory image must read back texel for texel,
+// and a truncated file must be refused.
+static void SkyTextureRoundTrip()
+{
+    const int width = 300, height = 150;
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            uint8_t *p = &pixels[(size_t(y) * width + x) * 4];
+            p[0] = static_cast<uint8_t>(x);
+            p[1] = static_cast<uint8_t>(y);
+            p[2] = static_cast<uint8_t>(x * 7 + y * 13);
+            p[3] = 255;
+        }
+    Image image{pixels.data(), width, height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string path = (dir / "numerics_test.bhsky").string(), truncated = (dir / "numerics_test_cut.bhsky").string();
+
+    bool converted = SkyTexture::Convert(image, path, 64); // 64 does not divide 300 or 150: edge tiles pad
+    bool opened = false, levelsOk = false;
+    int mismatches = 0;
+    double centreError = 0.0;
+    {
+        SkyTexture sky;
+        opened = converted && sky.Open(path);
+        if (opened)
+        {
+            int last = sky.Levels() - 1;
+            levelsOk = sky.Width(0) == width && sky.Height(0) == height && sky.Width(last) == 1 && sky.Height(last) == 1;
+            for (int y = 0; y < height; ++y)
+                for (int x = 0; x < width; ++x)
+                {
+                    const uint8_t *texel = sky.Texel(0, x, y), *p = &pixels[(size_t(y) * width + x) * 4];
+                    mismatches += std::equal(p, p + 4, texel) ? 0 : 1;
+
+                    // At a texel centre the bilinear lookup is that texel alone
+                    Vector3 c = sky.Bilinear(0, x + 0.5f, y + 0.5f);
+                    centreError = std::max({centreError, std::abs(double(c.x) - SkyTexture::Linear(p[0])),
+                                            std::abs(double(c.y) - SkyTexture::Linear(p[1])),
+                                            std::abs(double(c.z) - SkyTexture::Linear(p[2]))});
+                }
+        }
+    }
+
+    bool refused = false;
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!bytes.empty())
+        {
+            std::ofstream(truncated, std::ios::binary).write(bytes.data(), std::streamsize(bytes.size() - 1));
+            SkyTexture sky;
+            refused = !sky.Open(truncated);
+        }
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove(truncated);
+
+    Check(converted && opened, "SkyTexture Convert/Open", converted ? (opened ? "written and mapped" : "Open failed")
+                                                                    : "Convert failed");
+    Check(levelsOk && mismatches == 0 && centreError < 1e-6, "SkyTexture level 0 round trip",
+          std::to_string(mismatches) + " texels differ, centre error " + Format("%.1e", centreError));
+    Check(refused, "SkyTexture truncated file", refused ? "refused" : "accepted");
+}
+
+int main()
+{
+    PhiloxKnownAnswers();
+    InverseOfMetrics();
+    PotentialInvariant();
+    LensMapRoundTrip();
+    SkyTextureRoundTrip();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}